@@ -0,0 +1,317 @@
+#include "../waveform.hpp"
+#include "../wav/cache.hpp"
+#include "../wav/generator.hpp"
+#include "../wav/mix.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <numbers>
+#include <string>
+#include <vector>
+
+// Usage:
+//   bench [options] > results.jsonl
+//      --seconds <s>      length of the generated signal (default 10)
+//      --rate <hz>        sample rate (default 44100)
+//      --channels <n>     interleaved channels (default 1)
+//      --bits <8|16|24|32>  PCM bit depth of the generated file (default 16)
+//      --repeat <n>       timed runs per benchmark, the median is reported (default 5)
+//      --threads <n>      workers for Waveform::parallel, 0 uses every core (default 1)
+//      --dir <path>       where the scratch files go (default: the system temporary directory)
+//
+// Every benchmark prints one JSON object per line, so runs of different releases can be diffed or loaded into
+// any tool. Processing benchmarks only run on 16-bit files, the format convolution and normalization work with
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    double seconds = 10;
+    int rate = 44100;
+    int channels = 1;
+    int bits = 16;
+    int repeat = 5;
+    int threads = 1;
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+};
+
+// Deterministic test signal: three partials plus low-level white noise from a fixed-seed LCG,
+// each channel slightly detuned so channels are not identical. Amplitude in [-0.9, 0.9]
+class SignalGenerator {
+private:
+    uint32_t _state = 0x2545F491u;
+
+public:
+    double operator()(size_t frame, int channel, int rate)
+    {
+        double t = (double)frame / rate;
+        double w = 2 * std::numbers::pi_v<double> * (440.0 + channel);
+
+        _state = _state * 1664525u + 1013904223u;
+        double noise = (double)(_state >> 8) / (1 << 24) * 2.0 - 1.0;
+
+        return 0.5 * std::sin(w * t) + 0.25 * std::sin(3 * w * t) + 0.1 * std::sin(7.5 * w * t) + 0.05 * noise;
+    }
+};
+
+void write_signal(const std::string& filename, const Options& options)
+{
+    size_t frames = (size_t)(options.seconds * options.rate);
+    int sample_bytes = options.bits / 8;
+
+    wav::WAVHeader header = { { 'R', 'I', 'F', 'F' }, 0, { 'W', 'A', 'V', 'E' }, { 'f', 'm', 't', ' ' }, 16, 1,
+        (short)options.channels, options.rate, options.rate * options.channels * sample_bytes,
+        (short)(options.channels * sample_bytes), (short)options.bits, { 'd', 'a', 't', 'a' }, 0 };
+
+    std::vector<char> data(frames * options.channels * sample_bytes);
+    char* out = data.data();
+
+    SignalGenerator signal;
+    for (size_t frame = 0; frame < frames; frame++) {
+        for (int channel = 0; channel < options.channels; channel++) {
+            double x = signal(frame, channel, options.rate);
+
+            // 8-bit PCM is unsigned, every other depth is two's complement little-endian
+            if (options.bits == 8) {
+                *out++ = (char)(uint8_t)std::lrint(128 + x * 127);
+                continue;
+            }
+
+            int32_t value = (int32_t)std::lrint(x * (double)((1ll << (options.bits - 1)) - 1));
+            memcpy(out, &value, sample_bytes);
+            out += sample_bytes;
+        }
+    }
+
+    auto bytes = wav::encode_header(header, data.size());
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+    file.write(data.data(), data.size());
+}
+
+// Times `repeat` runs of `run`, each preceded by an untimed `setup`, and prints the result as one JSON line
+template <typename Setup, typename Run>
+void measure(const std::string& name, const Options& options, size_t samples, size_t bytes, Setup setup, Run run)
+{
+    std::vector<double> times;
+
+    for (int i = 0; i < std::max(options.repeat, 1); i++) {
+        setup();
+
+        auto start = Clock::now();
+        run();
+        auto end = Clock::now();
+
+        times.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    std::sort(times.begin(), times.end());
+    double median = times[times.size() / 2];
+    double mean = 0;
+    for (double time : times)
+        mean += time / times.size();
+
+    double seconds = std::max(median, 1.0) * 1e-9;
+
+    printf("{\"bench\":\"%s\",\"samples\":%zu,\"bytes\":%zu,\"channels\":%d,\"bits\":%d,\"rate\":%d,\"threads\":%d,"
+           "\"repeat\":%zu,\"min_ns\":%.0f,\"median_ns\":%.0f,\"mean_ns\":%.0f,\"max_ns\":%.0f,"
+           "\"samples_per_s\":%.1f,\"mb_per_s\":%.2f}\n",
+        name.c_str(), samples, bytes, options.channels, options.bits, options.rate, options.threads, times.size(),
+        times.front(), median, mean, times.back(), samples / seconds, bytes / seconds / 1e6);
+    fflush(stdout);
+}
+
+// Runs a filter over a fresh copy of the source on every repetition
+template <typename Functor>
+void measure_filter(const std::string& name, const Options& options, const wav::Waveform& source, Functor action)
+{
+    wav::Waveform copy;
+    size_t samples = source.samples().size();
+
+    measure(
+        "filter/" + name, options, samples, samples * sizeof(short), [&] { copy = source; copy.data(); },
+        [&] { copy.filter(action); });
+}
+
+int main(int argC, char** argV)
+{
+    Options options;
+
+    for (int i = 1; i < argC; i++) {
+        std::string arg = argV[i];
+        bool has_value = i + 1 < argC;
+
+        if (arg == "--seconds" && has_value)
+            options.seconds = std::stod(argV[++i]);
+        else if (arg == "--rate" && has_value)
+            options.rate = std::stoi(argV[++i]);
+        else if (arg == "--channels" && has_value)
+            options.channels = std::stoi(argV[++i]);
+        else if (arg == "--bits" && has_value)
+            options.bits = std::stoi(argV[++i]);
+        else if (arg == "--repeat" && has_value)
+            options.repeat = std::stoi(argV[++i]);
+        else if (arg == "--threads" && has_value)
+            options.threads = std::stoi(argV[++i]);
+        else if (arg == "--dir" && has_value)
+            options.dir = argV[++i];
+        else {
+            std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.bits % 8 != 0 || options.bits < 8 || options.bits > 32 || options.channels < 1 || options.rate < 1) {
+        std::cerr << "Bad signal format, exiting..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string source = (options.dir / "bench_source.wav").string();
+    std::string destination = (options.dir / "bench_output.wav").string();
+    write_signal(source, options);
+
+    size_t file_bytes = (size_t)std::filesystem::file_size(source);
+    size_t data_bytes = file_bytes - 44;
+    size_t samples = data_bytes / (options.bits / 8);
+
+    auto nothing = [] {};
+
+    // I/O: format-agnostic, run for every bit depth
+    measure("probe", options, 0, 44, nothing, [&] { wav::probe(source); });
+
+    // The waveform type matching the generated format
+    wav::visit(source, [&](auto& loaded) {
+        measure("load/buffered", options, samples, data_bytes, nothing, [&] { loaded.load(source); });
+        measure("load/mapped", options, samples, data_bytes, nothing, [&] { loaded.load(source, wav::IOMode::Mapped); });
+
+        // A fresh waveform per file, like batch processing: new buffers every time, or recycled through a pool
+        using Loaded = std::remove_reference_t<decltype(loaded)>;
+        wav::memory::Pool pool;
+        measure("load/fresh", options, samples, data_bytes, nothing, [&] { Loaded fresh(source); });
+        measure("load/pooled", options, samples, data_bytes, nothing, [&] {
+            Loaded fresh;
+            fresh.memory(&pool).load(source);
+        });
+        measure("load/planar", options, samples, data_bytes, nothing,
+            [&] { loaded.load(source, wav::IOMode::Buffered, wav::Layout::Planar); });
+        measure("save/planar", options, samples, data_bytes, nothing,
+            [&] { loaded.save(destination, wav::IOMode::Buffered, false); });
+
+        loaded.load(source);
+        measure("save/buffered", options, samples, data_bytes, nothing,
+            [&] { loaded.save(destination, wav::IOMode::Buffered, false); });
+        measure("save/mapped", options, samples, data_bytes, nothing,
+            [&] { loaded.save(destination, wav::IOMode::Mapped, false); });
+    });
+
+    // Signal generation into a preallocated 16-bit buffer of the test signal's length
+    std::vector<short> generated((size_t)(options.seconds * options.rate) * options.channels);
+    auto generate = [&](const std::string& name, auto oscillator) {
+        measure("generate/" + name, options, generated.size(), generated.size() * sizeof(short), nothing,
+            [&] { wav::generator::generate(oscillator, std::span<short>(generated), options.channels); });
+    };
+
+    generate("sine", wav::generator::Sine(997, options.rate, 0.9));
+    generate("multitone", wav::generator::MultiTone({ { 440, 0.5 }, { 1320, 0.25 }, { 3300, 0.1 } }, options.rate));
+    generate("square", wav::generator::Square(997, options.rate, 0.9));
+    generate("sweep", wav::generator::Sweep(20, 20000, options.seconds, options.rate, 0.9));
+    generate("noise", wav::generator::Noise(options.rate, 0.9));
+    generate("noise-pink", wav::generator::Noise(options.rate, 0.9, wav::generator::Noise::Color::Pink));
+
+    if (options.bits == 16) {
+        using namespace demo::filters;
+
+        wav::Waveform original(source);
+        original.parallel(options.threads);
+
+        measure_filter("clip", options, original, Clip<short>(INT16_MAX / 3));
+        measure_filter("gain", options, original, Gain<short>(2));
+        measure_filter("gain-float", options, original, Gain<float, short>(1.7f));
+        measure_filter("pulsify", options, original, Pulsify<float, short>(0.2f));
+        measure_filter("normalize", options, original, Normalize<float, short>(1.2f));
+        measure_filter("chain", options, original, wav::chain(Gain<short>(2), Clip<short>(INT16_MAX / 2)));
+
+        wav::Waveform copy;
+        auto fresh = [&] { copy = original; copy.data(); };
+
+        // Mutable access drops the cached statistics, so every run is a full scan
+        measure("analyze", options, samples, data_bytes, fresh, [&] { copy.analyze(); });
+
+        measure("normalize", options, samples, data_bytes, fresh, [&] { copy.normalize(); });
+
+        // Three-band EQ and a steep lowpass, in both precisions
+        auto eq = wav::iir::Cascade().highpass(40).peaking(1000, 3).high_shelf(8000, -2);
+        auto steep = wav::iir::Cascade().butterworth_lowpass(5000, 8);
+        for (auto precision : { wav::iir::Precision::Float, wav::iir::Precision::Double }) {
+            std::string suffix = precision == wav::iir::Precision::Float ? "" : "-double";
+            measure("biquad/eq" + suffix, options, samples, data_bytes, fresh, [&] { copy.biquad(eq, precision); });
+            measure("biquad/lowpass8" + suffix, options, samples, data_bytes, fresh,
+                [&] { copy.biquad(steep, precision); });
+        }
+
+        // Result cache keys hash every input sample, which should cost little next to any processing
+        measure("hash", options, samples, data_bytes, nothing, [&] {
+            auto view = original.samples();
+            wav::Hash64().update(view.data(), view.size_bytes()).digest();
+        });
+
+        // Building the pyramid reads every sample once; a query costs the same for the whole signal as for a second
+        measure("overview/build", options, samples, data_bytes, nothing, [&] { original.overview(); });
+        wav::Overview overview = original.overview();
+        measure("overview/query", options, 1920, 0, nothing, [&] { overview.query(0, overview.frames(), 1920); });
+
+        // The detector's cost does not depend on how far it looks ahead
+        for (double lookahead : { 5.0, 500.0 }) {
+            auto limiter = wav::dynamics::Settings::limiter(-6, 50, lookahead);
+            measure("dynamics/limiter-" + std::to_string((int)lookahead) + "ms", options, samples, data_bytes, fresh,
+                [&] { copy.dynamics(limiter); });
+        }
+        auto compressor = wav::dynamics::Settings::compressor(-20, 4);
+        measure("dynamics/compressor", options, samples, data_bytes, fresh, [&] { copy.dynamics(compressor); });
+
+        // Eight stems, each panned and shifted by a few milliseconds, into stereo; the mix is dropped
+        // From memory the cost is the summing alone, streamed stems add reading them block by block
+        for (bool streamed : { false, true }) {
+            wav::Mixer mixer(options.rate, 2);
+            mixer.parallel(options.threads);
+            for (int stem = 0; stem < 8; stem++) {
+                wav::Mixer::Placement placement { 0.25f, stem / 3.5f - 1, stem * 100 };
+                streamed ? mixer.add(source, placement) : mixer.add(original, placement);
+            }
+
+            measure(std::string("mix/8-stems") + (streamed ? "-streamed" : ""), options, samples * 8, data_bytes * 8,
+                nothing, [&] { mixer.render([](std::span<const short>) { return true; }); });
+        }
+
+        // Up, down and by a large factor; the first run builds the tables, later ones reuse them
+        for (int rate : { 48000, 96000, 22050 })
+            measure("resample/" + std::to_string(rate), options, samples, data_bytes, fresh, [&] { copy.resample(rate); });
+
+        // Analysis only, the magnitudes are dropped; 75% overlap at two frame sizes
+        for (size_t size : { 512, 4096 }) {
+            wav::stft::Analyzer analyzer({ size, size / 4, wav::stft::Window::Hann });
+            measure("stft/" + std::to_string(size), options, samples, data_bytes, nothing,
+                [&] { original.spectrum(analyzer, [](uint64_t, std::span<const float>) { }); });
+        }
+
+        // Kernel lengths on both sides of the direct / FFT switch
+        for (size_t taps : { 13, 64, 65, 256, 1024, 4096, 16384, 65536 }) {
+            std::vector<float> kernel(taps);
+            for (size_t i = 0; i < taps; i++)
+                kernel[i] = (float)(std::sin(0.37 * (double)i) / (double)(i + 1));
+
+            // First use builds and caches the convolver, like repeated calls in an application would
+            wav::Convolver::get(kernel);
+
+            measure("convolute/" + std::to_string(taps), options, samples, data_bytes, fresh,
+                [&] { copy.convolute(kernel); });
+        }
+    }
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(destination);
+
+    return EXIT_SUCCESS;
+}
@@ -1,9 +1,346 @@
 #include "./waveform.hpp"
+#include "./wav/batch.hpp"
+#include "./wav/mix.hpp"
+#include "./wav/pipe.hpp"
+#include "./wav/stream.hpp"
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Usage:
+//   demo <file.wav>           print the header and save a modulated copy of the file
+//      --stats-json <path>    also write per-stage timings as JSON ('-' for stdout, needs -DWAV_STATS)
+//   demo --pipe [options]     gain + clip stdin to stdout, block by block, for live audio chains
+//      --raw                  input is headerless 16-bit PCM rather than a WAVE stream
+//      --block <frames>       frames per block (default 256)
+//      --gain <factor>        gain applied before clipping (default 1)
+//      --clip <level>         clipping threshold (default 32767)
+//   demo --probe <files...>   one line of format information per file, without reading the samples
+//   demo --spectrogram [options] <file.wav>
+//                             write a compact binary spectrogram of the file, streamed in bounded memory
+//      --size <samples>       FFT length, a power of two (default 2048)
+//      --hop <samples>        samples between frames (default 512)
+//      --window <name>        hann, hamming, blackman or rectangular (default hann)
+//      --threads <n>          workers, 0 uses every core (default 0)
+//      --out <path>           where the spectrogram goes (default <file>.spg)
+//   demo --batch [options] <inputs...>
+//                             apply a filter chain to many files (directories, files, or @list.txt) on all cores
+//      --chain <spec>         steps, e.g. gain=1.5,clip=24000,normalize (default normalize, see wav/batch.hpp)
+//      --out <dir>            where results go, named after their inputs (default batch_out)
+//      --jobs <n>             workers, 0 uses every core (default 0)
+//      --grain <samples>      smallest block a file is split into between workers (default 65536)
+//      --mapped               memory-map the inputs instead of reading them
+//      --cache <dir>          reuse results of unchanged inputs from earlier runs, kept in <dir>
+//      --cache-size <MB>      least recently used results are dropped beyond this (default 1024)
+//   demo --mix [options] [stem options] <stem.wav> [[stem options] <stem.wav> ...]
+//                             sum 16-bit stems into one file, streaming them from disk block by block
+//      --out <path>           where the mix goes (default mix.wav)
+//      --channels <n>         channels of the mix (default 2)
+//      --master <factor>      gain applied to the sum (default 1)
+//      --threads <n>          workers, 0 uses every core (default 0)
+//      --gain <factor>        gain of the next stem (default 1)
+//      --pan <position>       pan of the next stem, -1 (left) to 1 (right) (default 0)
+//      --at <seconds>         where the next stem starts in the mix (default 0)
+
+int probe_mode(int argC, char** argV)
+{
+    int status = EXIT_SUCCESS;
+
+    for (int i = 2; i < argC; i++) {
+        try {
+            wav::Probe probe = wav::probe(argV[i]);
+            const wav::WAVHeader& header = probe.header;
+
+            std::cout << argV[i] << ": format " << header.audio_format << ", " << header.num_channels << " ch, "
+                      << header.sample_rate << " Hz, " << header.bits_per_sample << " bit, " << probe.data_bytes()
+                      << " bytes at " << probe.data_offset << ", " << probe.duration() << "s, chunks:";
+
+            for (const auto& chunk : probe.chunks.chunks)
+                std::cout << " " << std::string(chunk.id.data(), 4);
+
+            std::cout << std::endl;
+        } catch (const std::exception& error) {
+            std::cerr << argV[i] << ": " << error.what() << std::endl;
+            status = EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+int batch_mode(int argC, char** argV)
+{
+    std::string spec = "normalize", output = "batch_out", cache;
+    uint64_t cache_size = wav::ResultCache::default_capacity;
+    int jobs = 0;
+    size_t grain = wav::Parallelism::default_grain;
+    wav::IOMode mode = wav::IOMode::Buffered;
+    std::vector<std::string> inputs;
+
+    try {
+        for (int i = 2; i < argC; i++) {
+            std::string arg = argV[i];
+            bool has_value = i + 1 < argC;
+
+            if (arg == "--chain" && has_value)
+                spec = argV[++i];
+            else if (arg == "--out" && has_value)
+                output = argV[++i];
+            else if (arg == "--jobs" && has_value)
+                jobs = std::stoi(argV[++i]);
+            else if (arg == "--grain" && has_value)
+                grain = std::stoul(argV[++i]);
+            else if (arg == "--mapped")
+                mode = wav::IOMode::Mapped;
+            else if (arg == "--cache" && has_value)
+                cache = argV[++i];
+            else if (arg == "--cache-size" && has_value)
+                cache_size = (uint64_t)(std::stod(argV[++i]) * (1 << 20));
+            else if (arg.rfind("--", 0) != 0)
+                inputs.push_back(arg);
+            else {
+                std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        wav::Batch batch(wav::Recipe(spec), output, jobs, grain, mode);
+        if (cache.empty() == false)
+            batch.cache(std::make_shared<wav::ResultCache>(cache, cache_size));
+
+        wav::Batch::Result result = batch.run(wav::Batch::collect(inputs));
+
+        std::cout << "Processed " << result.files - result.failed << " of " << result.files << " files";
+        if (cache.empty() == false)
+            std::cout << " (" << result.cached << " from the cache)";
+
+        std::cout << ", " << result.bytes / 1e6 << " MB in " << result.seconds << "s ("
+                  << result.bytes / 1e6 / std::max(result.seconds, 1e-9) << " MB/s)" << std::endl;
+
+        return result.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int spectrogram_mode(int argC, char** argV)
+{
+    wav::stft::Settings settings;
+    int threads = 0;
+    std::string input, output;
+
+    try {
+        for (int i = 2; i < argC; i++) {
+            std::string arg = argV[i];
+            bool has_value = i + 1 < argC;
+
+            if (arg == "--size" && has_value)
+                settings.size = std::stoul(argV[++i]);
+            else if (arg == "--hop" && has_value)
+                settings.hop = std::stoul(argV[++i]);
+            else if (arg == "--threads" && has_value)
+                threads = std::stoi(argV[++i]);
+            else if (arg == "--out" && has_value)
+                output = argV[++i];
+            else if (arg == "--window" && has_value) {
+                std::string name = argV[++i];
+                if (name == "hann")
+                    settings.window = wav::stft::Window::Hann;
+                else if (name == "hamming")
+                    settings.window = wav::stft::Window::Hamming;
+                else if (name == "blackman")
+                    settings.window = wav::stft::Window::Blackman;
+                else if (name == "rectangular")
+                    settings.window = wav::stft::Window::Rectangular;
+                else {
+                    std::cerr << "Unknown window '" << name << "', exiting..." << std::endl;
+                    return EXIT_FAILURE;
+                }
+            } else if (arg.rfind("--", 0) != 0 && input.empty())
+                input = arg;
+            else {
+                std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (input.empty()) {
+            std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (output.empty())
+            output = input + ".spg";
+
+        auto start = std::chrono::steady_clock::now();
+
+        wav::Stream stream(input);
+        stream.parallel(threads, settings.size * 16);
+        if (stream.spectrogram(output, settings))
+            return EXIT_FAILURE;
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const wav::WAVHeader& header = stream.header();
+        double duration = (double)stream.frames() / std::max<int>(header.sample_rate, 1);
+
+        std::cout << "Analyzed " << duration << "s of audio in " << seconds << "s ("
+                  << duration / std::max(seconds, 1e-9) << "x real time)" << std::endl;
+
+        return EXIT_SUCCESS;
+    } catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int mix_mode(int argC, char** argV)
+{
+    std::string output = "mix.wav";
+    int channels = 2, threads = 0;
+    float master = 1.0f;
+
+    // Positions are kept in seconds until the sample rate is known
+    std::vector<std::pair<std::string, wav::Mixer::Placement>> stems;
+    std::vector<double> starts;
+    wav::Mixer::Placement next;
+    double at = 0;
+
+    try {
+        for (int i = 2; i < argC; i++) {
+            std::string arg = argV[i];
+            bool has_value = i + 1 < argC;
+
+            if (arg == "--out" && has_value)
+                output = argV[++i];
+            else if (arg == "--channels" && has_value)
+                channels = std::stoi(argV[++i]);
+            else if (arg == "--master" && has_value)
+                master = std::stof(argV[++i]);
+            else if (arg == "--threads" && has_value)
+                threads = std::stoi(argV[++i]);
+            else if (arg == "--gain" && has_value)
+                next.gain = std::stof(argV[++i]);
+            else if (arg == "--pan" && has_value)
+                next.pan = std::stof(argV[++i]);
+            else if (arg == "--at" && has_value)
+                at = std::stod(argV[++i]);
+            else if (arg.rfind("--", 0) != 0) {
+                stems.emplace_back(arg, next);
+                starts.push_back(at);
+                next = wav::Mixer::Placement();
+                at = 0;
+            } else {
+                std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (stems.empty()) {
+            std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        // The first stem sets the sample rate of the mix
+        int rate = wav::probe(stems.front().first).header.sample_rate;
+        wav::Mixer mixer(rate, channels);
+        mixer.parallel(threads).master(master);
+
+        for (size_t i = 0; i < stems.size(); i++) {
+            stems[i].second.offset = (int64_t)std::llround(starts[i] * rate);
+            mixer.add(stems[i].first, stems[i].second);
+        }
+
+        if (mixer.save(output))
+            return EXIT_FAILURE;
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double duration = (double)mixer.frames() / rate;
+
+        std::cout << "Mixed " << stems.size() << " stems into " << duration << "s of audio in " << seconds << "s ("
+                  << duration / std::max(seconds, 1e-9) << "x real time)" << std::endl;
+
+        return EXIT_SUCCESS;
+    } catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int pipe_mode(int argC, char** argV)
+{
+    bool wav_input = true;
+    size_t frames = 256;
+    float gain = 1.0f;
+    short clip = INT16_MAX;
+
+    // std::stoi and friends throw std::invalid_argument or std::out_of_range on malformed numbers
+    try {
+        for (int i = 2; i < argC; i++) {
+            std::string arg = argV[i];
+            bool has_value = i + 1 < argC;
+
+            if (arg == "--raw")
+                wav_input = false;
+            else if (arg == "--block" && has_value)
+                frames = std::stoul(argV[++i]);
+            else if (arg == "--gain" && has_value)
+                gain = std::stof(argV[++i]);
+            else if (arg == "--clip" && has_value) {
+                int level = std::stoi(argV[++i]);
+                if (level < 0 || level > INT16_MAX) {
+                    std::cerr << "Clipping threshold must be within [0, 32767], exiting..." << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                clip = (short)level;
+            } else {
+                std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::logic_error&) {
+        std::cerr << "Bad commandline arguments, exiting..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    wav::Pipe pipe(wav::chain(demo::filters::Gain<short>(gain), demo::filters::Clip<short>(clip)), frames);
+    int status = pipe.run(stdin, stdout, wav_input);
+
+    // stdout carries the audio, the report goes to stderr
+    const auto& latency = pipe.latency();
+    std::cerr << "Blocks: " << latency.count() << ", latency [us] p50: " << latency.percentile(50) / 1000.0
+              << ", p90: " << latency.percentile(90) / 1000.0 << ", p99: " << latency.percentile(99) / 1000.0
+              << ", p99.9: " << latency.percentile(99.9) / 1000.0 << ", max: " << latency.max() / 1000.0 << std::endl;
+
+    return status == wav::SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argC, char** argV)
 {
-    if (argC != 2) {
+    if (argC >= 2 && strcmp(argV[1], "--pipe") == 0)
+        return pipe_mode(argC, argV);
+
+    if (argC >= 2 && strcmp(argV[1], "--probe") == 0)
+        return probe_mode(argC, argV);
+
+    if (argC >= 2 && strcmp(argV[1], "--batch") == 0)
+        return batch_mode(argC, argV);
+
+    if (argC >= 2 && strcmp(argV[1], "--spectrogram") == 0)
+        return spectrogram_mode(argC, argV);
+
+    if (argC >= 2 && strcmp(argV[1], "--mix") == 0)
+        return mix_mode(argC, argV);
+
+    std::string stats_path;
+    if (argC == 4 && strcmp(argV[2], "--stats-json") == 0)
+        stats_path = argV[3];
+    else if (argC != 2) {
         std::cerr << "Bad commandline arguments, exiting..." << std::endl;
         return EXIT_FAILURE;
     }
@@ -21,11 +358,20 @@ int main(int argC, char** argV)
     // audio.save("original_" + std::string(argV[1]));
 
     // Perfom filtering on the provided waveform
+    // The copy shares the samples of the original until convolute() writes its own
     auto modulated = audio;
     modulated.convolute({ 0.1f, 0, -0.2f, 0, 0.3f, 0, -0.1f, 0, 0.01f, 0, -0.1f, 0, 0.1111f });
     modulated.normalize();
     modulated.save("modulated_" + std::string(argV[1]));
 
+    // The copy carries the load timings of the original along, so this covers the whole job
+    if (stats_path == "-") {
+        modulated.stats().json(std::cout) << std::endl;
+    } else if (stats_path.empty() == false) {
+        std::ofstream stats(stats_path);
+        modulated.stats().json(stats) << std::endl;
+    }
+
     // // Apply a gain filter of 0.5 factor (ratio)
     // modulated = audio;
     // modulated.filter(demo::filters::Gain<short>(0.3));
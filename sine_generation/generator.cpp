@@ -1,4 +1,4 @@
-#include "../waveform.hpp"
+#include "../wav/generator.hpp"
 #include <cmath>
 #include <numbers>
 
@@ -53,29 +53,29 @@ public:
 
     void generate()
     {
-        _filedata.data().clear();
-
-        double w = 2 * std::numbers::pi_v<double> * frequency;
         double sample_rate = _filedata.header().sample_rate;
-
         std::size_t num_samples = static_cast<size_t>(sample_rate * duration);
 
-        for (std::size_t i = 0; i < num_samples; i++) {
-            double t = static_cast<double>(i) / sample_rate;
-            double x = amplitude * std::sin(w * t + phase);
+        // Sized once and rendered block by block, see wav/generator.hpp
+        auto& samples = _filedata.data();
+        samples.resize(num_samples);
 
-            std::int16_t sample = static_cast<std::int16_t>(x * std::numeric_limits<std::int16_t>::max());
-            _filedata.data().push_back(sample);
-        }
+        wav::generator::Sine sine(frequency, static_cast<int>(sample_rate), amplitude, phase);
+        wav::generator::generate(sine, std::span<std::int16_t>(samples));
 
-        std::cout << _filedata.data().size() << " samples generated..." << std::endl;
+        std::cout << samples.size() << " samples generated..." << std::endl;
         update_header();
     }
 
-    void declick()
+    void declick(float threshold = 0.01f)
     {
-        declick_in();
-        declick_out();
+        // Both ends are found by index first, then trimmed with a single erase each
+        std::size_t first = declick_in(threshold);
+        std::size_t last = declick_out(threshold, first);
+
+        auto& samples = _filedata.data();
+        samples.erase(samples.begin() + last, samples.end());
+        samples.erase(samples.begin(), samples.begin() + first);
 
         update_header();
     }
@@ -88,22 +88,31 @@ public:
 private:
     void update_header()
     {
-        double sample_rate = _filedata.header().sample_rate;
-        std::size_t num_samples = static_cast<size_t>(sample_rate * duration);
-        _filedata.header().subchunk2_size = num_samples * sizeof(std::int16_t) * _filedata.header().num_channels;
+        _filedata.header().subchunk2_size = _filedata.num_samples() * sizeof(std::int16_t);
     }
 
-    void declick_in(float threshold = 0.01f)
+    // Index of the first sample below the threshold
+    std::size_t declick_in(float threshold) const
     {
-        while (calc_amplitude(_filedata.data().at(0)) >= threshold) {
-            _filedata.data().erase(_filedata.data().cbegin());
-        }
+        auto samples = _filedata.samples();
+
+        std::size_t first = 0;
+        while (first < samples.size() && calc_amplitude(samples[first]) >= threshold)
+            first++;
+
+        return first;
     }
 
-    void declick_out(float threshold = 0.01f)
+    // One past the last sample below the threshold, not before `first`
+    std::size_t declick_out(float threshold, std::size_t first) const
     {
-        while (calc_amplitude(_filedata.data().at(_filedata.data().size() - 1)) >= threshold)
-            _filedata.data().pop_back();
+        auto samples = _filedata.samples();
+
+        std::size_t last = samples.size();
+        while (last > first && calc_amplitude(samples[last - 1]) >= threshold)
+            last--;
+
+        return last;
     }
 };
 
@@ -116,8 +125,7 @@ int main()
     sg.save("generated_sine.wav");
 
     wav::Waveform sine("generated_sine.wav");
-    sine.filter(demo::filters::Gain<short>(2));
-    sine.filter(demo::filters::Clip<short>(INT16_MAX / 2));
+    sine.filter(wav::chain(demo::filters::Gain<short>(2), demo::filters::Clip<short>(INT16_MAX / 2)));
     sine.save("modulated_sine.wav");
 
     return EXIT_SUCCESS;
@@ -0,0 +1,437 @@
+#ifndef _WAV_BATCH_H
+#define _WAV_BATCH_H
+
+#include "../waveform.hpp"
+#include "cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace wav {
+
+// Filter chain assembled at runtime from a spec such as "gain=1.5,clip=24000,normalize"
+// Steps, applied left to right:
+//   gain=<factor>             Gain<float, short>
+//   clip=<level>              Clip<short>
+//   pulsify=<threshold>       Pulsify<float, short>, threshold within [0, 1]
+//   normalize                 brings the peak to full scale
+//   lowpass=<hz>, highpass=<hz>  second-order Butterworth sections (see wav/iir.hpp)
+//   resample=<hz>             converts to the given sample rate (see wav/resample.hpp)
+//   limit=<dBFS>              lookahead limiter with the given ceiling (see wav/dynamics.hpp)
+//   compress=<dBFS>:<ratio>   lookahead compressor
+//   gate=<dBFS>               lookahead gate, 80 dB of attenuation below the threshold
+//   convolve=<tap>:<tap>:...  FIR filter with the given taps
+// Consecutive per-sample steps are fused into one pass over the samples, tile by tile like wav::Chain, and
+// consecutive lowpass and highpass steps into one cascade
+// canonical() spells a spec the same way however it was written ("gain=1.50,,clip=24000.0" and
+// "gain=1.5,clip=24000" are one recipe), which is what result caches key on
+class Recipe {
+private:
+    // Fused per-sample steps, applied through Waveform::filter like any block filter
+    struct Stages {
+        std::vector<std::function<void(std::span<short>)>> kernels;
+
+        void process(std::span<short> samples)
+        {
+            for (size_t begin = 0; begin < samples.size(); begin += Chain<>::tile) {
+                auto block = samples.subspan(begin, std::min(Chain<>::tile, samples.size() - begin));
+                for (auto& kernel : kernels)
+                    kernel(block);
+            }
+        }
+    };
+
+    std::vector<std::function<void(Waveform&)>> _steps;
+    std::string _canonical;
+
+public:
+    Recipe() = default;
+
+    // Throws std::invalid_argument naming the offending step
+    explicit Recipe(const std::string& spec)
+    {
+        Stages stages;
+        iir::Cascade cascade;
+
+        auto flush_stages = [this, &stages] {
+            if (stages.kernels.empty())
+                return;
+
+            _steps.push_back([stages](Waveform& waveform) { waveform.filter(stages); });
+            stages.kernels.clear();
+        };
+        auto flush_cascade = [this, &cascade] {
+            if (cascade.empty())
+                return;
+
+            _steps.push_back([cascade](Waveform& waveform) { waveform.biquad(cascade); });
+            cascade = iir::Cascade();
+        };
+        auto flush = [&] {
+            flush_stages();
+            flush_cascade();
+        };
+
+        for (size_t begin = 0; begin <= spec.size();) {
+            size_t end = std::min(spec.find(',', begin), spec.size());
+            std::string step = spec.substr(begin, end - begin);
+            begin = end + 1;
+
+            if (step.empty())
+                continue;
+
+            size_t separator = step.find('=');
+            std::string name = step.substr(0, separator);
+            std::string value = separator == std::string::npos ? "" : step.substr(separator + 1);
+
+            _canonical += (_canonical.empty() ? "" : ",") + name;
+
+            if (name == "gain") {
+                flush_cascade();
+                float factor = (float)number(name, value);
+                stages.kernels.push_back(kernel(demo::filters::Gain<float, short>(factor)));
+                _canonical += "=" + spell(factor);
+            } else if (name == "clip") {
+                flush_cascade();
+                double threshold = number(name, value);
+                if (!(threshold >= 0 && threshold <= INT16_MAX))
+                    throw std::invalid_argument("Step 'clip' needs a level within [0, 32767], got '" + value + "'.");
+
+                short level = (short)threshold;
+                stages.kernels.push_back(kernel(demo::filters::Clip<short>(level)));
+                _canonical += "=" + std::to_string(level);
+            } else if (name == "pulsify") {
+                flush_cascade();
+                float threshold = (float)number(name, value);
+                stages.kernels.push_back(kernel(demo::filters::Pulsify<float, short>(threshold)));
+                _canonical += "=" + spell(threshold);
+            } else if (name == "lowpass") {
+                flush_stages();
+                double frequency = number(name, value);
+                cascade.lowpass(frequency);
+                _canonical += "=" + spell(frequency);
+            } else if (name == "highpass") {
+                flush_stages();
+                double frequency = number(name, value);
+                cascade.highpass(frequency);
+                _canonical += "=" + spell(frequency);
+            } else if (name == "resample") {
+                flush();
+                int rate = (int)number(name, value);
+                if (rate <= 0)
+                    throw std::invalid_argument("Step 'resample' needs a positive rate, got '" + value + "'.");
+
+                _steps.push_back([rate](Waveform& waveform) { waveform.resample(rate); });
+                _canonical += "=" + std::to_string(rate);
+            } else if (name == "limit" || name == "compress" || name == "gate") {
+                flush();
+                size_t colon = value.find(':');
+                double threshold = number(name, value.substr(0, colon));
+
+                dynamics::Settings settings = dynamics::Settings::limiter(threshold);
+                if (name == "gate")
+                    settings = dynamics::Settings::gate(threshold);
+                else if (name == "compress" && colon != std::string::npos)
+                    settings = dynamics::Settings::compressor(threshold, number(name, value.substr(colon + 1)));
+                else if (name == "compress")
+                    throw std::invalid_argument("Step 'compress' needs <threshold>:<ratio>, got '" + value + "'.");
+
+                if (settings.ratio < 1)
+                    throw std::invalid_argument("Step 'compress' needs a ratio of at least 1, got '" + value + "'.");
+
+                _steps.push_back([settings](Waveform& waveform) { waveform.dynamics(settings); });
+                _canonical += "=" + spell(threshold) + (name == "compress" ? ":" + spell(settings.ratio) : "");
+            } else if (name == "normalize") {
+                flush();
+                _steps.push_back([](Waveform& waveform) { waveform.normalize(); });
+            } else if (name == "convolve") {
+                std::vector<float> taps;
+                for (size_t first = 0; first <= value.size();) {
+                    size_t last = std::min(value.find(':', first), value.size());
+                    taps.push_back((float)number(name, value.substr(first, last - first)));
+                    first = last + 1;
+                }
+
+                // Built once here, shared by every file (and thread) the recipe is applied to
+                flush();
+                auto convolver = Convolver::get(taps);
+                _steps.push_back([convolver](Waveform& waveform) { waveform.convolute(*convolver); });
+
+                for (size_t i = 0; i < taps.size(); i++)
+                    _canonical += (i == 0 ? "=" : ":") + spell(taps[i]);
+            } else {
+                throw std::invalid_argument("Unknown step '" + name + "' in filter spec.");
+            }
+        }
+
+        flush();
+    }
+
+    bool empty() const { return _steps.empty(); }
+
+    const std::string& canonical() const { return _canonical; }
+
+    void apply(Waveform& waveform) const
+    {
+        for (const auto& step : _steps)
+            step(waveform);
+    }
+
+private:
+    template <typename Filter>
+    static std::function<void(std::span<short>)> kernel(Filter filter)
+    {
+        return [filter](std::span<short> block) mutable { apply_filter(filter, block); };
+    }
+
+    static double number(const std::string& name, const std::string& value)
+    {
+        try {
+            size_t used = 0;
+            double result = std::stod(value, &used);
+            if (used == value.size())
+                return result;
+        } catch (const std::logic_error&) {
+        }
+
+        throw std::invalid_argument("Step '" + name + "' needs a numeric value, got '" + value + "'.");
+    }
+
+    // Shortest spelling that reads back as the same value
+    template <typename T>
+    static std::string spell(T value)
+    {
+        char text[32];
+        auto end = std::to_chars(text, text + sizeof(text), value).ptr;
+        return std::string(text, end);
+    }
+};
+
+// Applies a recipe to many files, writing each result under the same name into an output directory
+// Files are tasks for a pool of workers, so while one worker reads its next file others process or write theirs,
+// and the disk and the cores stay busy together. Within a file, filters, analysis and convolution split the samples
+// into blocks (see Waveform::parallel) that idle workers pick up, so a few large inputs at the end of a job do not
+// leave the rest of the pool waiting. Largest files are started first for the same reason
+// Sample buffers come from a pool shared by the workers, so a file reuses the (already paged-in) buffers of the
+// files before it instead of allocating its own
+// With a result cache (see cache()), a file whose samples and format were already processed by the same recipe is
+// copied from the cache instead, so rerunning a job after changing some of its inputs only processes those
+// Without OpenMP, files are processed one after another
+class Batch {
+public:
+    struct Result {
+        size_t files = 0;
+        size_t failed = 0;
+        size_t cached = 0;
+        uint64_t bytes = 0;
+        double seconds = 0;
+    };
+
+    // Part of every cache key; changing it orphans the entries of earlier versions, for when a step's output changes
+    static constexpr const char* cache_version = "batch/1";
+
+private:
+    Recipe _recipe;
+    std::filesystem::path _output;
+    Parallelism _parallelism;
+    IOMode _mode;
+    std::unique_ptr<memory::Pool> _pool = std::make_unique<memory::Pool>();
+    std::shared_ptr<ResultCache> _cache;
+
+public:
+    // `jobs` workers (0: every core), splitting files into blocks of at least `grain` samples
+    Batch(Recipe recipe, std::filesystem::path output, int jobs = 0, size_t grain = Parallelism::default_grain,
+        IOMode mode = IOMode::Buffered)
+        : _recipe(std::move(recipe))
+        , _output(std::move(output))
+        , _parallelism { jobs, grain }
+        , _mode(mode)
+    {
+    }
+
+    // Looks results up in, and stores new ones into, `cache`; null turns caching off
+    Batch& cache(std::shared_ptr<ResultCache> cache)
+    {
+        _cache = std::move(cache);
+        return *this;
+    }
+
+    // Hash of what a file's result depends on: the sample format and the samples themselves, whatever the other
+    // chunks (or the file name) hold. The data chunk is hashed straight from the mapped file
+    static uint64_t fingerprint(const std::filesystem::path& file)
+    {
+        Probe info = probe(file.string());
+        MappedFile mapping(file.string());
+
+        size_t available = mapping.size() > info.data_offset ? mapping.size() - info.data_offset : 0;
+        size_t bytes = std::min(info.data_bytes(), available);
+
+        const WAVHeader& header = info.header;
+        Hash64 hash;
+        hash.update(&header.audio_format, sizeof(header.audio_format));
+        hash.update(&header.num_channels, sizeof(header.num_channels));
+        hash.update(&header.sample_rate, sizeof(header.sample_rate));
+        hash.update(&header.bits_per_sample, sizeof(header.bits_per_sample));
+        hash.update(mapping.data() + info.data_offset, bytes);
+
+        return hash.digest();
+    }
+
+    // Directories contribute the .wav files directly inside them, "@list.txt" one path per line, anything else is
+    // taken as a file
+    static std::vector<std::filesystem::path> collect(const std::vector<std::string>& inputs)
+    {
+        std::vector<std::filesystem::path> files;
+
+        for (const std::string& input : inputs) {
+            if (input.size() > 1 && input[0] == '@') {
+                std::ifstream list(input.substr(1));
+                if (list.is_open() == false)
+                    throw std::runtime_error("Specified file list could not be opened.");
+
+                for (std::string line; std::getline(list, line);)
+                    if (line.empty() == false)
+                        files.emplace_back(line);
+            } else if (std::filesystem::is_directory(input)) {
+                std::vector<std::filesystem::path> found;
+                for (const auto& entry : std::filesystem::directory_iterator(input))
+                    if (entry.is_regular_file() && entry.path().extension() == ".wav")
+                        found.push_back(entry.path());
+
+                std::sort(found.begin(), found.end());
+                files.insert(files.end(), found.begin(), found.end());
+            } else {
+                files.emplace_back(input);
+            }
+        }
+
+        return files;
+    }
+
+    // Failures are reported on `errors` per file and do not stop the batch
+    Result run(const std::vector<std::filesystem::path>& inputs, std::ostream& errors = std::cerr)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        std::error_code error;
+        std::filesystem::create_directories(_output, error);
+
+        // Outputs are named after their inputs, so only the first of several same-named inputs is processed
+        std::set<std::filesystem::path> names;
+        std::vector<std::filesystem::path> accepted;
+        for (const auto& file : inputs) {
+            if (names.insert(file.filename()).second)
+                accepted.push_back(file);
+            else
+                errors << file.string() << ": Another input has the same name, skipped." << std::endl;
+        }
+
+        std::vector<std::filesystem::path> files = largest_first(accepted);
+        std::atomic<size_t> failed { inputs.size() - files.size() };
+        std::atomic<uint64_t> bytes { 0 };
+        std::atomic<size_t> cached { 0 };
+        std::mutex report;
+
+        int workers = _parallelism.workers();
+        long long count = (long long)files.size();
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(workers)
+#pragma omp single
+#endif
+        for (long long i = 0; i < count; i++) {
+#ifdef _OPENMP
+#pragma omp task
+#endif
+            {
+                const std::filesystem::path& file = files[(size_t)i];
+
+                try {
+                    bool hit = false;
+                    bytes += process(file, workers, hit);
+                    cached += hit;
+                } catch (const std::exception& exception) {
+                    std::lock_guard<std::mutex> guard(report);
+                    errors << file.string() << ": " << exception.what() << std::endl;
+                    failed++;
+                }
+            }
+        }
+
+        Result result;
+        result.files = inputs.size();
+        result.failed = failed;
+        result.cached = cached;
+        result.bytes = bytes;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        return result;
+    }
+
+private:
+    // Returns the number of sample bytes processed, none when the result came from the cache
+    uint64_t process(const std::filesystem::path& file, int workers, bool& hit) const
+    {
+        std::filesystem::path destination = _output / file.filename();
+
+        std::error_code error;
+        if (std::filesystem::equivalent(file, destination, error))
+            throw std::runtime_error("Output would overwrite the input.");
+
+        std::string key;
+        if (_cache) {
+            key = ResultCache::key(fingerprint(file), std::string(cache_version) + "|" + _recipe.canonical());
+            if ((hit = _cache->fetch(key, destination)))
+                return 0;
+        }
+
+        Waveform waveform;
+        waveform.memory(_pool.get()).parallel(workers, _parallelism.grain);
+        if (waveform.load(file.string(), _mode))
+            throw std::runtime_error("Specified file could not be opened.");
+
+        _recipe.apply(waveform);
+
+        if (waveform.save(destination.string(), IOMode::Buffered, false))
+            throw std::runtime_error("Could not save the result.");
+
+        if (_cache)
+            _cache->store(key, destination);
+
+        return waveform.num_samples() * sizeof(short);
+    }
+
+    // Order in which files are started
+    static std::vector<std::filesystem::path> largest_first(const std::vector<std::filesystem::path>& inputs)
+    {
+        std::vector<std::pair<uintmax_t, std::filesystem::path>> sized;
+
+        for (const auto& file : inputs) {
+            std::error_code error;
+            uintmax_t size = std::filesystem::file_size(file, error);
+            sized.emplace_back(error ? 0 : size, file);
+        }
+
+        std::stable_sort(sized.begin(), sized.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        std::vector<std::filesystem::path> files;
+        for (auto& [size, file] : sized)
+            files.push_back(std::move(file));
+
+        return files;
+    }
+};
+
+} // namespace wav
+
+#endif
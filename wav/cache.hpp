@@ -0,0 +1,307 @@
+#ifndef _WAV_CACHE_H
+#define _WAV_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace wav {
+
+// Fast 64-bit hash of a byte stream, XXH64 (same digests as xxHash's): four independent multiply-rotate lanes over
+// 32-byte stripes, so it runs at memory speed, then a final mix of the lanes and the tail
+// Not cryptographic, it tells apart inputs that differ, not inputs crafted to collide
+class Hash64 {
+private:
+    static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t _seed;
+    uint64_t _lanes[4];
+    unsigned char _pending[32];
+    size_t _buffered = 0;
+    uint64_t _length = 0;
+
+public:
+    explicit Hash64(uint64_t seed = 0)
+        : _seed(seed)
+        , _lanes { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 }
+    {
+    }
+
+    Hash64& update(const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        _length += size;
+
+        // Top up a partial stripe first
+        if (_buffered > 0) {
+            size_t taken = std::min(size, sizeof(_pending) - _buffered);
+            memcpy(_pending + _buffered, bytes, taken);
+            _buffered += taken;
+            bytes += taken;
+            size -= taken;
+
+            if (_buffered < sizeof(_pending))
+                return *this;
+
+            stripe(_pending);
+            _buffered = 0;
+        }
+
+        for (; size >= 32; bytes += 32, size -= 32)
+            stripe(bytes);
+
+        memcpy(_pending, bytes, size);
+        _buffered = size;
+
+        return *this;
+    }
+
+    Hash64& update(const std::string& text) { return update(text.data(), text.size()); }
+
+    uint64_t digest() const
+    {
+        uint64_t hash;
+        if (_length >= 32) {
+            hash = std::rotl(_lanes[0], 1) + std::rotl(_lanes[1], 7) + std::rotl(_lanes[2], 12) + std::rotl(_lanes[3], 18);
+            for (uint64_t lane : _lanes)
+                hash = (hash ^ round(0, lane)) * prime1 + prime4;
+        } else {
+            hash = _seed + prime5;
+        }
+
+        hash += _length;
+
+        const unsigned char* tail = _pending;
+        size_t left = _buffered;
+        for (; left >= 8; tail += 8, left -= 8)
+            hash = std::rotl(hash ^ round(0, load<uint64_t>(tail)), 27) * prime1 + prime4;
+        if (left >= 4) {
+            hash = std::rotl(hash ^ (uint64_t)load<uint32_t>(tail) * prime1, 23) * prime2 + prime3;
+            tail += 4;
+            left -= 4;
+        }
+        for (; left > 0; tail++, left--)
+            hash = std::rotl(hash ^ *tail * prime5, 11) * prime1;
+
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+private:
+    template <typename T>
+    static T load(const unsigned char* bytes)
+    {
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t input) { return std::rotl(lane + input * prime2, 31) * prime1; }
+
+    void stripe(const unsigned char* bytes)
+    {
+        for (int lane = 0; lane < 4; lane++)
+            _lanes[lane] = round(_lanes[lane], load<uint64_t>(bytes + lane * 8));
+    }
+};
+
+// Output files of processing jobs, stored under a key naming everything they were computed from (see key()), so a
+// job seen before is a file copy instead of a recomputation
+// Entries live as <key>.wav files in one directory, which may be shared between runs and processes. Once their
+// total size is over the capacity, the least recently used ones are deleted; a hit counts as a use
+// Thread-safe
+class ResultCache {
+public:
+    static constexpr uint64_t default_capacity = uint64_t(1) << 30;
+
+    struct Usage {
+        uint64_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evicted = 0;
+    };
+
+private:
+    std::filesystem::path _directory;
+    uint64_t _capacity;
+
+    mutable std::mutex _lock;
+    Usage _usage;
+    std::atomic<uint64_t> _temporary { 0 };
+
+public:
+    // Creates the directory when needed and evicts whatever is over the capacity already
+    // Throws std::filesystem::filesystem_error when the directory cannot be created
+    explicit ResultCache(std::filesystem::path directory, uint64_t capacity = default_capacity)
+        : _directory(std::move(directory))
+        , _capacity(capacity)
+    {
+        std::filesystem::create_directories(_directory);
+
+        std::lock_guard<std::mutex> guard(_lock);
+        for (const auto& entry : entries())
+            _usage.bytes += entry.size;
+
+        evict();
+    }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    const std::filesystem::path& directory() const { return _directory; }
+    uint64_t capacity() const { return _capacity; }
+
+    Usage usage() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _usage;
+    }
+
+    // Key for an input, given the hash of its contents, and a canonical description of how it is processed
+    static std::string key(uint64_t input, const std::string& description)
+    {
+        return hex(input) + hex(Hash64(input).update(description).digest());
+    }
+
+    // Copies the entry to `destination` and returns true, or returns false when there is none
+    bool fetch(const std::string& key, const std::filesystem::path& destination)
+    {
+        std::filesystem::path entry = path(key);
+        std::error_code error;
+
+        // An entry evicted by another worker in the meantime is a miss like any other
+        std::filesystem::copy_file(entry, destination, std::filesystem::copy_options::overwrite_existing, error);
+
+        std::lock_guard<std::mutex> guard(_lock);
+        if (error) {
+            _usage.misses++;
+            return false;
+        }
+
+        std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), error);
+        _usage.hits++;
+        return true;
+    }
+
+    // Stores a copy of `result` under the key; failures only mean the result is computed again next time
+    void store(const std::string& key, const std::filesystem::path& result)
+    {
+        std::error_code error;
+
+        // Copied under a name of its own and renamed into place, so no reader sees a partial entry
+        std::filesystem::path temporary = _directory / (key + "." + std::to_string(_temporary++) + ".tmp");
+        std::filesystem::copy_file(result, temporary, std::filesystem::copy_options::overwrite_existing, error);
+
+        std::lock_guard<std::mutex> guard(_lock);
+        if (error) {
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+
+        std::filesystem::path entry = path(key);
+        uint64_t replaced = std::filesystem::exists(entry, error) ? std::filesystem::file_size(entry, error) : 0;
+        uint64_t size = std::filesystem::file_size(temporary, error);
+
+        std::filesystem::rename(temporary, entry, error);
+        if (error) {
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+
+        _usage.bytes = _usage.bytes - std::min(replaced, _usage.bytes) + size;
+        evict();
+    }
+
+    // Deletes every entry
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (const auto& entry : entries()) {
+            std::error_code error;
+            std::filesystem::remove(entry.path, error);
+        }
+
+        _usage.bytes = 0;
+    }
+
+private:
+    struct Entry {
+        std::filesystem::path path;
+        uint64_t size;
+        std::filesystem::file_time_type used;
+    };
+
+    std::filesystem::path path(const std::string& key) const { return _directory / (key + ".wav"); }
+
+    std::vector<Entry> entries() const
+    {
+        std::vector<Entry> found;
+        std::error_code error;
+
+        for (const auto& item : std::filesystem::directory_iterator(_directory, error)) {
+            if (item.is_regular_file(error) == false || item.path().extension() != ".wav")
+                continue;
+
+            found.push_back({ item.path(), item.file_size(error), item.last_write_time(error) });
+        }
+
+        return found;
+    }
+
+    // Least recently used first, until the entries fit; the lock must be held
+    void evict()
+    {
+        if (_usage.bytes <= _capacity)
+            return;
+
+        std::vector<Entry> found = entries();
+        std::sort(found.begin(), found.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+
+        // Other processes may share the directory, so start from what is actually there
+        _usage.bytes = 0;
+        for (const Entry& entry : found)
+            _usage.bytes += entry.size;
+
+        for (const Entry& entry : found) {
+            if (_usage.bytes <= _capacity)
+                break;
+
+            std::error_code error;
+            if (std::filesystem::remove(entry.path, error)) {
+                _usage.bytes -= entry.size;
+                _usage.evicted++;
+            }
+        }
+    }
+
+    static std::string hex(uint64_t value)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string text(16, '0');
+        for (int i = 15; i >= 0; i--, value >>= 4)
+            text[i] = digits[value & 0xF];
+
+        return text;
+    }
+};
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef _WAV_CONVOLUTION_H
+#define _WAV_CONVOLUTION_H
+
+#include "fft.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace wav {
+
+// Rounds and saturates an accumulated value back into the 16-bit sample range
+inline short saturate(float value)
+{
+    value = std::clamp(value, (float)std::numeric_limits<short>::min(), (float)std::numeric_limits<short>::max());
+    return (short)std::lrint(value);
+}
+
+// Causal FIR convolution, y[i] = sum(kernel[j] * x[i - j])
+// Short kernels are applied directly in the time domain; longer ones go through a uniformly partitioned
+// overlap-save FFT convolution, whose kernel spectra are computed once and reused by every call
+// A Convolver is immutable after construction and can be shared between files and threads
+class Convolver {
+private:
+    std::vector<float> _reversed; // direct form: kernel in reverse order, so that each tap walks the input forwards
+    size_t _taps;
+
+    size_t _block = 0; // B: partition length, the FFT size is 2 * B
+    size_t _partitions = 0; // P: number of kernel partitions
+    std::shared_ptr<const fft::Plan> _plan;
+    std::vector<fft::complex> _spectra; // P * (B + 1) bins, pre-scaled by 1 / 2B
+
+public:
+    // Kernels up to this many taps are cheaper to apply directly
+    static constexpr size_t direct_threshold = 64;
+
+    // Upper bound for automatically chosen partitions, longer kernels are split into several
+    static constexpr size_t max_block = 16384;
+
+    // block = 0 picks the partition length from the kernel length
+    explicit Convolver(const std::vector<float>& kernel, size_t block = 0)
+        : _reversed(kernel.rbegin(), kernel.rend())
+        , _taps(kernel.size())
+    {
+        if (_taps <= direct_threshold && block == 0)
+            return;
+
+        _block = block != 0 ? fft::next_pow2(block) : std::clamp(fft::next_pow2(_taps), direct_threshold, max_block);
+        _partitions = (_taps + _block - 1) / _block;
+        _plan = fft::Plan::get(2 * _block);
+
+        size_t bins = _plan->bins();
+        float scale = 1.0f / (float)_plan->size();
+
+        std::vector<float> segment(_plan->size());
+        _spectra.resize(_partitions * bins);
+
+        for (size_t p = 0; p < _partitions; p++) {
+            // Partition p occupies the first half of the window, the second half is zero padding
+            std::fill(segment.begin(), segment.end(), 0.0f);
+            for (size_t j = 0; j < _block && p * _block + j < _taps; j++)
+                segment[j] = kernel[p * _block + j] * scale;
+
+            _plan->forward(segment.data(), &_spectra[p * bins]);
+        }
+    }
+
+    size_t size() const { return _taps; }
+    bool direct() const { return _plan == nullptr; }
+
+    // Computes `count` outputs from `input`, which holds the size() - 1 samples preceding the first output
+    // followed by the `count` samples aligned with the outputs (a "valid" convolution)
+    // The input and output ranges must not overlap; outputs are independent, so they can be split across threads
+    void valid(const short* input, size_t count, short* output, const Parallelism& parallelism = {}) const
+    {
+        if (count == 0)
+            return;
+
+        if (_taps == 0) {
+            std::fill(output, output + count, (short)0);
+            return;
+        }
+
+        if (direct()) {
+            parallel_for(count, parallelism, [&](size_t, size_t begin, size_t end) {
+                valid_direct(input + begin, end - begin, output + begin);
+            });
+
+            return;
+        }
+
+        // Every task primes its own delay line with P - 1 extra transforms, so give it enough blocks to amortize that
+        Parallelism blocks = parallelism;
+        blocks.grain = std::max((parallelism.grain + _block - 1) / _block, 4 * _partitions);
+
+        parallel_for((count + _block - 1) / _block, blocks, [&](size_t, size_t first, size_t last) {
+            valid_partitioned(input, count, output, first, last);
+        });
+    }
+
+    // Convolvers built from plain kernels are cached, so the same impulse response is transformed only once
+    static std::shared_ptr<const Convolver> get(const std::vector<float>& kernel)
+    {
+        static std::mutex lock;
+        static std::map<std::vector<float>, std::shared_ptr<const Convolver>> convolvers;
+
+        // Reverb-length kernels are big, keep only a handful around
+        constexpr size_t capacity = 8;
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto found = convolvers.find(kernel);
+        if (found != convolvers.end())
+            return found->second;
+
+        if (convolvers.size() >= capacity)
+            convolvers.clear();
+
+        auto convolver = std::make_shared<const Convolver>(kernel);
+        convolvers.emplace(kernel, convolver);
+
+        return convolver;
+    }
+
+private:
+    void valid_direct(const short* input, size_t count, short* output) const
+    {
+        // Outputs are accumulated in tiles, so the tap loop runs over contiguous memory and vectorizes
+        constexpr size_t tile = 256;
+        float accumulator[tile];
+
+        for (size_t begin = 0; begin < count; begin += tile) {
+            size_t length = std::min(tile, count - begin);
+            std::fill(accumulator, accumulator + length, 0.0f);
+
+            for (size_t j = 0; j < _taps; j++) {
+                float tap = _reversed[j];
+                const short* source = input + begin + j;
+
+                for (size_t i = 0; i < length; i++)
+                    accumulator[i] += tap * (float)source[i];
+            }
+
+            for (size_t i = 0; i < length; i++)
+                output[begin + i] = saturate(accumulator[i]);
+        }
+    }
+
+    // Renders output blocks [first, last), each B samples long
+    // Every block needs the spectra of the P most recent input windows, kept in a frequency-domain delay line
+    void valid_partitioned(const short* input, size_t count, short* output, size_t first, size_t last) const
+    {
+        size_t bins = _plan->bins();
+        size_t window = _plan->size();
+        size_t input_size = count + _taps - 1;
+
+        // Scratch comes from the calling thread's pool, so repeated convolutions reuse it
+        std::pmr::memory_resource* scratch = &memory::local();
+        std::pmr::vector<fft::complex> delay_line(_partitions * bins, scratch);
+        std::pmr::vector<fft::complex> accumulator(bins, scratch);
+        std::pmr::vector<float> samples(window, scratch);
+
+        // Window for output block b spans input [b * B + taps - 1 - B, b * B + taps - 1 + B), zero outside the input
+        auto transform = [&](ptrdiff_t b, fft::complex* spectrum) {
+            ptrdiff_t start = b * (ptrdiff_t)_block + (ptrdiff_t)_taps - 1 - (ptrdiff_t)_block;
+
+            for (size_t i = 0; i < window; i++) {
+                ptrdiff_t index = start + (ptrdiff_t)i;
+                samples[i] = (index >= 0 && index < (ptrdiff_t)input_size) ? (float)input[index] : 0.0f;
+            }
+
+            _plan->forward(samples.data(), spectrum);
+        };
+
+        // Prime the delay line with the windows preceding the first block
+        for (size_t p = 1; p < _partitions; p++) {
+            ptrdiff_t b = (ptrdiff_t)first - (ptrdiff_t)p;
+            transform(b, &delay_line[(b + (ptrdiff_t)_partitions) % (ptrdiff_t)_partitions * bins]);
+        }
+
+        for (size_t b = first; b < last; b++) {
+            transform((ptrdiff_t)b, &delay_line[(b % _partitions) * bins]);
+
+            std::fill(accumulator.begin(), accumulator.end(), fft::complex(0.0f, 0.0f));
+            for (size_t p = 0; p < _partitions; p++) {
+                const fft::complex* x = &delay_line[((b + _partitions - p) % _partitions) * bins];
+                const fft::complex* h = &_spectra[p * bins];
+
+                for (size_t k = 0; k < bins; k++)
+                    accumulator[k] += fft::mul(x[k], h[k]);
+            }
+
+            // Overlap-save: the first half of the window is circular wrap-around, the second half is valid
+            _plan->inverse(accumulator.data(), samples.data());
+
+            size_t begin = b * _block;
+            size_t length = std::min(_block, count - begin);
+            for (size_t i = 0; i < length; i++)
+                output[begin + i] = saturate(samples[_block + i]);
+        }
+    }
+};
+
+// Streaming application of a Convolver, block after block
+// Carries the last size() - 1 input samples of every channel (the filter tail) from one block into the next, so
+// processing a signal in blocks gives the same output as convolving it whole (bit-exact for direct kernels, within
+// float rounding for FFT ones). Interleaved channels are convolved one by one, like Waveform::convolute, so they
+// never bleed into each other; blocks must hold whole frames
+class ConvolutionState {
+private:
+    std::shared_ptr<const Convolver> _convolver;
+    int _channels;
+    size_t _tail;
+    std::vector<short> _history; // per channel, _tail samples
+    std::vector<short> _input; // a channel's history followed by its part of the current block, reused
+    std::vector<short> _output; // a channel's part of the current block, convolved
+
+public:
+    explicit ConvolutionState(std::shared_ptr<const Convolver> convolver, int channels = 1)
+        : _convolver(std::move(convolver))
+        , _channels(std::max(channels, 1))
+        , _tail(_convolver->size() > 0 ? _convolver->size() - 1 : 0)
+        , _history(_tail * _channels, 0)
+    {
+    }
+
+    const Convolver& convolver() const { return *_convolver; }
+    int channels() const { return _channels; }
+
+    // Forget everything seen so far, as if the next block started the signal
+    void reset() { std::fill(_history.begin(), _history.end(), (short)0); }
+
+    // Convolves the block in place
+    void process(std::span<short> block, const Parallelism& parallelism = {})
+    {
+        size_t frames = block.size() / _channels;
+        _input.resize(_tail + frames);
+        _output.resize(frames);
+
+        for (int channel = 0; channel < _channels; channel++) {
+            short* history = _history.data() + channel * _tail;
+
+            std::copy(history, history + _tail, _input.begin());
+            for (size_t i = 0; i < frames; i++)
+                _input[_tail + i] = block[i * _channels + channel];
+
+            _convolver->valid(_input.data(), frames, _output.data(), parallelism);
+
+            for (size_t i = 0; i < frames; i++)
+                block[i * _channels + channel] = _output[i];
+
+            // The most recent size() - 1 inputs become the next block's history
+            std::copy(_input.end() - (ptrdiff_t)_tail, _input.end(), history);
+        }
+    }
+};
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef _WAV_COPY_ON_WRITE_H
+#define _WAV_COPY_ON_WRITE_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace wav {
+
+// Value shared between copies until one of them modifies it
+// Copying only bumps a reference count; write() hands out a private instance, cloning the shared one first if
+// anybody else still holds it. Copies may be modified on different threads, one object must not be
+template <typename T>
+class CopyOnWrite {
+private:
+    std::shared_ptr<T> _value;
+
+    // Token of whoever the instance is lent to, see lend(); not passed on to copies
+    std::shared_ptr<void> _borrower;
+
+public:
+    CopyOnWrite() = default;
+
+    // While the instance is lent out, a copy clones it at once rather than sharing what the borrowers write to
+    CopyOnWrite(const CopyOnWrite& other)
+        : _value(other.lent() ? clone(*other._value) : other._value)
+    {
+    }
+    CopyOnWrite(CopyOnWrite&&) = default;
+
+    CopyOnWrite& operator=(const CopyOnWrite& other)
+    {
+        if (this != &other) {
+            _value = other.lent() ? clone(*other._value) : other._value;
+            _borrower.reset();
+        }
+
+        return *this;
+    }
+    CopyOnWrite& operator=(CopyOnWrite&&) = default;
+
+    const T& operator*() const { return _value ? *_value : empty(); }
+    const T* operator->() const { return &**this; }
+
+    // A reference into the instance is only stable until this object is copied
+    T& write()
+    {
+        if (_value == nullptr)
+            _value = std::make_shared<T>();
+        else if (_value.use_count() > 1)
+            _value = clone(*_value);
+        else
+            // Whoever held the last other reference is done with it, its reads happen before our writes
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+        return *_value;
+    }
+
+    // Like write(), for borrowers that keep writing through the reference after this object is copied (e.g. views),
+    // as long as any of them holds a copy of `token`; copies made meanwhile get an instance of their own
+    T& lend(const std::shared_ptr<void>& token)
+    {
+        T& value = write();
+        _borrower = token;
+        return value;
+    }
+
+    // Token of the last lend(), kept after the borrowers let go of it and across reset() and clear()
+    const std::shared_ptr<void>& borrower() const { return _borrower; }
+    bool lent() const { return _value != nullptr && _borrower.use_count() > 1; }
+
+    // Replaces the value without copying the previous one
+    T& reset(T value)
+    {
+        _value = std::make_shared<T>(std::move(value));
+        return *_value;
+    }
+    void clear() { _value.reset(); }
+    bool has_value() const { return _value != nullptr; }
+
+    // Whether write() would have to copy
+    bool shared() const { return _value != nullptr && _value.use_count() > 1; }
+
+private:
+    // Containers keep their allocator in the copy (a plain copy of a std::pmr container would fall back to the
+    // default resource)
+    static std::shared_ptr<T> clone(const T& value)
+    {
+        if constexpr (requires { value.get_allocator(); })
+            return std::make_shared<T>(value, value.get_allocator());
+        else
+            return std::make_shared<T>(value);
+    }
+
+    static const T& empty()
+    {
+        static const T value {};
+        return value;
+    }
+};
+
+} // namespace wav
+
+#endif
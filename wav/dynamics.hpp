@@ -0,0 +1,308 @@
+#ifndef _WAV_DYNAMICS_H
+#define _WAV_DYNAMICS_H
+
+#include "iir.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Dynamics processing with lookahead: limiter, compressor and gate
+// The detector takes the peak of the next `lookahead` worth of samples, so gain changes start before the signal
+// that causes them reaches the output, and a limiter never lets a peak through. Output is delayed by the
+// lookahead; Waveform::dynamics and wav::Stream take that delay out again
+namespace wav {
+namespace dynamics {
+    // Maximum of the last `window` values pushed, at a constant cost per value however long the window
+    // Keeps a deque of the values that can still become the maximum (each larger than every later one), so the
+    // front is the maximum; every value enters and leaves the deque once
+    template <typename T>
+    class SlidingMax {
+    private:
+        std::vector<T> _values;
+        std::vector<uint64_t> _positions;
+        size_t _mask;
+
+        uint64_t _window;
+        uint64_t _count = 0;
+        size_t _head = 0, _tail = 0;
+
+    public:
+        explicit SlidingMax(size_t window)
+            : _window(std::max<size_t>(window, 1))
+        {
+            // Room for a full window plus the value pushed before the oldest one expires
+            size_t capacity = 1;
+            while (capacity < _window + 1)
+                capacity <<= 1;
+
+            _values.resize(capacity);
+            _positions.resize(capacity);
+            _mask = capacity - 1;
+        }
+
+        void reset()
+        {
+            _count = 0;
+            _head = _tail = 0;
+        }
+
+        // Maximum of the window ending with `value`
+        T push(T value)
+        {
+            while (_tail != _head && _values[(_tail - 1) & _mask] <= value)
+                _tail--;
+
+            _values[_tail & _mask] = value;
+            _positions[_tail & _mask] = _count;
+            _tail++;
+
+            // The window moves by one, so at most one value falls out of it
+            if (_positions[_head & _mask] + _window <= _count)
+                _head++;
+
+            _count++;
+            return _values[_head & _mask];
+        }
+    };
+
+    enum class Mode {
+        // Gain reduction above the threshold, by the ratio
+        Compress,
+        // Attenuation by the range below the threshold
+        Gate
+    };
+
+    // Levels in dBFS and dB, times in milliseconds
+    struct Settings {
+        Mode mode = Mode::Compress;
+        double threshold = -1;
+
+        // Compress: dB over the threshold in for every dB out, infinity limits
+        double ratio = std::numeric_limits<double>::infinity();
+
+        // Gate: attenuation below the threshold
+        double range = 80;
+
+        // How far the detector looks ahead, which is also how long gain reductions take to ramp in
+        double lookahead = 5;
+
+        // Time constant for the gain to recover (compress) or the gate to close
+        double release = 100;
+
+        // Gate: time constant for the gate to open
+        double attack = 1;
+
+        // Gain applied after the dynamics
+        double makeup = 0;
+
+        // One gain for all channels, from the loudest of them, which keeps the stereo image in place
+        bool linked = true;
+
+        // No sample above the ceiling leaves it
+        static Settings limiter(double ceiling = -1, double release = 50, double lookahead = 5)
+        {
+            Settings settings;
+            settings.threshold = ceiling;
+            settings.release = release;
+            settings.lookahead = lookahead;
+            return settings;
+        }
+
+        static Settings compressor(double threshold, double ratio, double release = 100, double lookahead = 5,
+            double makeup = 0)
+        {
+            Settings settings;
+            settings.threshold = threshold;
+            settings.ratio = ratio;
+            settings.release = release;
+            settings.lookahead = lookahead;
+            settings.makeup = makeup;
+            return settings;
+        }
+
+        static Settings gate(double threshold, double range = 80, double release = 100, double lookahead = 5)
+        {
+            Settings settings;
+            settings.mode = Mode::Gate;
+            settings.threshold = threshold;
+            settings.range = range;
+            settings.release = release;
+            settings.lookahead = lookahead;
+            return settings;
+        }
+    };
+
+    // Settings applied to interleaved 16-bit frames of `channels` channels at one sample rate, as a block filter
+    // Per frame, the detector takes the peak of the next latency() frames (through a SlidingMax) and maps it
+    // through the static curve to a target gain. Gain falls to a lower target at once (compress) or with the
+    // release (gate) and rises with the release (compress) or attack (gate); a moving average over the lookahead
+    // then turns every step into a ramp that ends as the peak reaches the output
+    // Every channel (or group of linked channels) keeps its state from one block to the next, so a signal
+    // processed block by block comes out as if it had been processed whole. Blocks must hold whole frames
+    class Processor {
+    public:
+        static constexpr bool sequential = true;
+
+    private:
+        Settings _settings;
+        int _channels;
+        int _groups;
+        size_t _latency;
+
+        float _threshold; // linear, in sample units
+        float _slope; // Compress: exponent of the gain curve above the threshold
+        float _floor; // Gate: linear gain below the threshold
+        float _makeup;
+        double _average; // 1 / (latency() + 1)
+        double _down, _up; // one-pole coefficients per frame
+
+        // Per group
+        std::vector<SlidingMax<int>> _detectors;
+        std::vector<double> _gain;
+        std::vector<int> _peak; // last window peak and its target, which often stays put for many frames
+        std::vector<float> _target;
+
+        // Per group, the gains of the last latency() + 1 frames and their sum
+        std::vector<float> _window;
+        std::vector<double> _sum;
+
+        // Per channel, the last latency() input samples
+        std::vector<short> _delay;
+
+        // Where the current frame goes in the gain windows and the delay lines
+        size_t _slot = 0, _tap = 0;
+
+    public:
+        // Throws std::invalid_argument for a ratio below 1, negative times or a sample rate that is not positive
+        Processor(const Settings& settings, double rate, int channels = 1)
+            : _settings(settings)
+            , _channels(std::max(channels, 1))
+            , _groups(settings.linked ? 1 : _channels)
+        {
+            if (rate <= 0 || settings.ratio < 1 || settings.lookahead < 0 || settings.release < 0 || settings.attack < 0)
+                throw std::invalid_argument("Dynamics need a ratio of at least 1 and times that are not negative.");
+
+            _latency = (size_t)std::lround(settings.lookahead * rate / 1000);
+            _threshold = (float)(32768 * std::pow(10.0, settings.threshold / 20));
+            _slope = std::isinf(settings.ratio) ? -1.0f : (float)(1 / settings.ratio - 1);
+            _floor = (float)std::pow(10.0, -std::abs(settings.range) / 20);
+            _makeup = (float)std::pow(10.0, settings.makeup / 20);
+            _average = 1.0 / (double)(_latency + 1);
+
+            auto coefficient = [rate](double milliseconds) {
+                return milliseconds > 0 ? 1 - std::exp(-1000 / (milliseconds * rate)) : 1.0;
+            };
+
+            bool gate = settings.mode == Mode::Gate;
+            _down = gate ? coefficient(settings.release) : 1.0;
+            _up = gate ? coefficient(settings.attack) : coefficient(settings.release);
+
+            _detectors.assign(_groups, SlidingMax<int>(_latency + 1));
+            _window.resize(_groups * (_latency + 1));
+            _delay.resize(_channels * _latency);
+
+            reset();
+        }
+
+        int channels() const { return _channels; }
+
+        // Frames from a sample entering to it leaving
+        size_t latency() const { return _latency; }
+
+        // Forget everything seen so far, as if the next block started the signal (after latency() frames of
+        // silence)
+        void reset()
+        {
+            for (auto& detector : _detectors)
+                detector.reset();
+
+            // Settled on silence: a compressor at unity, a gate closed
+            float initial = curve(0);
+
+            _gain.assign(_groups, initial);
+            _peak.assign(_groups, 0);
+            _target.assign(_groups, initial);
+            std::fill(_window.begin(), _window.end(), initial);
+            _sum.assign(_groups, (double)initial * (double)(_latency + 1));
+            std::fill(_delay.begin(), _delay.end(), (short)0);
+            _slot = _tap = 0;
+        }
+
+        void process(std::span<short> samples)
+        {
+            size_t frames = samples.size() / _channels;
+            int members = _channels / _groups;
+
+            for (size_t i = 0; i < frames; i++) {
+                short* frame = samples.data() + i * _channels;
+
+                for (int group = 0; group < _groups; group++) {
+                    short* first = frame + group * members;
+
+                    int peak = 0;
+                    for (int channel = 0; channel < members; channel++)
+                        peak = std::max(peak, std::abs((int)first[channel]));
+
+                    float gain = smooth(group, _detectors[group].push(peak));
+
+                    // Out goes the sample from latency() frames ago, in comes the new one
+                    short* delayed = &_delay[(size_t)group * members * _latency];
+                    for (int channel = 0; channel < members; channel++) {
+                        short input = first[channel];
+
+                        if (_latency > 0)
+                            std::swap(input, delayed[(size_t)channel * _latency + _tap]);
+
+                        first[channel] = iir::detail::quantize((float)input * gain);
+                    }
+                }
+
+                _slot = _slot == _latency ? 0 : _slot + 1;
+                _tap = _tap + 1 >= _latency ? 0 : _tap + 1;
+            }
+        }
+
+    private:
+        // Gain for the frame leaving now, given the peak of the window that ends with the frame entering
+        float smooth(int group, int peak)
+        {
+            if (peak != _peak[group]) {
+                _peak[group] = peak;
+                _target[group] = curve((float)peak);
+            }
+
+            double target = _target[group];
+            double& gain = _gain[group];
+            gain += (target - gain) * (target < gain ? _down : _up);
+
+            // Moving average over latency() + 1 frames
+            float& oldest = _window[(size_t)group * (_latency + 1) + _slot];
+            float newest = (float)gain;
+            _sum[group] += (double)newest - (double)oldest;
+            oldest = newest;
+
+            return (float)(_sum[group] * _average) * _makeup;
+        }
+
+        // Static curve: target gain for a peak, in sample units
+        float curve(float peak) const
+        {
+            if (_settings.mode == Mode::Gate)
+                return peak < _threshold ? _floor : 1.0f;
+
+            if (peak <= _threshold)
+                return 1.0f;
+
+            return _slope == -1.0f ? _threshold / peak : std::pow(peak / _threshold, _slope);
+        }
+    };
+} // namespace dynamics
+} // namespace wav
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef _WAV_FFT_H
+#define _WAV_FFT_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+namespace wav {
+namespace fft {
+    using complex = std::complex<float>;
+
+    // Plain complex product - std::complex's operator* guards against NaN/inf and does not inline
+    inline complex mul(const complex& a, const complex& b)
+    {
+        return complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+    }
+
+    inline size_t next_pow2(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+            result <<= 1;
+
+        return result;
+    }
+
+    // Real-input FFT of a fixed, power-of-two size
+    // The transform is computed as a half-size complex FFT over the even/odd sample pairs, followed by a split step
+    // Plans are immutable once built, so a single plan can be shared between threads; all buffers are caller-owned
+    class Plan {
+    private:
+        size_t _size; // number of real samples (N)
+        size_t _half; // size of the underlying complex transform (N / 2)
+
+        std::vector<uint32_t> _bitrev; // bit-reversal permutation of the complex transform
+        std::vector<complex> _twiddles; // e^(-2*pi*i*k / (N/2)), k < N/4
+        std::vector<complex> _split; // e^(-2*pi*i*k / N), k <= N/4
+
+    public:
+        explicit Plan(size_t size)
+            : _size(size)
+            , _half(size / 2)
+        {
+            if (size < 4 || (size & (size - 1)) != 0)
+                throw std::invalid_argument("FFT size must be a power of two, at least 4.");
+
+            unsigned bits = 0;
+            while ((size_t(1) << bits) < _half)
+                bits++;
+
+            _bitrev.resize(_half);
+            for (size_t i = 0; i < _half; i++) {
+                uint32_t reversed = 0;
+                for (unsigned b = 0; b < bits; b++)
+                    reversed |= ((i >> b) & 1u) << (bits - 1 - b);
+
+                _bitrev[i] = reversed;
+            }
+
+            _twiddles.resize(_half / 2);
+            for (size_t k = 0; k < _twiddles.size(); k++) {
+                double angle = -2.0 * std::numbers::pi * (double)k / (double)_half;
+                _twiddles[k] = complex((float)std::cos(angle), (float)std::sin(angle));
+            }
+
+            _split.resize(_half / 2 + 1);
+            for (size_t k = 0; k < _split.size(); k++) {
+                double angle = -2.0 * std::numbers::pi * (double)k / (double)_size;
+                _split[k] = complex((float)std::cos(angle), (float)std::sin(angle));
+            }
+        }
+
+        size_t size() const { return _size; }
+        size_t bins() const { return _half + 1; }
+
+        // in: size() real samples, out: bins() complex bins (DC .. Nyquist)
+        void forward(const float* in, complex* out) const
+        {
+            // Pack the real signal as N/2 complex values, (x[2k], x[2k + 1])
+            std::copy(in, in + _size, reinterpret_cast<float*>(out));
+            transform(out, false);
+
+            // Split the packed spectrum into the spectrum of the real signal
+            complex z0 = out[0];
+            out[0] = complex(z0.real() + z0.imag(), 0.0f);
+            out[_half] = complex(z0.real() - z0.imag(), 0.0f);
+
+            for (size_t k = 1; k <= _half / 2; k++) {
+                size_t m = _half - k;
+                complex zk = out[k], zm = std::conj(out[m]);
+
+                complex even = (zk + zm) * 0.5f;
+                complex odd = mul(zk - zm, complex(0.0f, -0.5f));
+
+                complex xk = even + mul(_split[k], odd);
+                // X[N/2 - k] = conj(E[k] - W^k * O[k])
+                complex xm = std::conj(even - mul(_split[k], odd));
+
+                out[k] = xk;
+                out[m] = xm;
+            }
+        }
+
+        // in: bins() complex bins, out: size() real samples, scaled by size() (the transform is unnormalized)
+        // The input spectrum is left untouched
+        void inverse(const complex* in, float* out) const
+        {
+            // out doubles as the N/2 complex work buffer
+            complex* z = reinterpret_cast<complex*>(out);
+
+            z[0] = complex(in[0].real() + in[_half].real(), in[0].real() - in[_half].real());
+
+            for (size_t k = 1; k <= _half / 2; k++) {
+                size_t m = _half - k;
+                complex xk = in[k], xm = std::conj(in[m]);
+
+                complex even = xk + xm;
+                complex odd = mul(xk - xm, std::conj(_split[k]));
+
+                // Z[k] = E[k] + i * O[k], and both halves are Hermitian: Z[N/2 - k] = conj(E[k]) + i * conj(O[k])
+                z[k] = even + mul(complex(0.0f, 1.0f), odd);
+                z[m] = std::conj(even) + mul(complex(0.0f, 1.0f), std::conj(odd));
+            }
+
+            transform(z, true);
+        }
+
+        // Plans are cached per size, so repeated convolutions and analyses share their tables
+        static std::shared_ptr<const Plan> get(size_t size)
+        {
+            static std::mutex lock;
+            static std::map<size_t, std::shared_ptr<const Plan>> plans;
+
+            std::lock_guard<std::mutex> guard(lock);
+
+            auto& plan = plans[size];
+            if (plan == nullptr)
+                plan = std::make_shared<const Plan>(size);
+
+            return plan;
+        }
+
+    private:
+        // In-place iterative radix-2 complex FFT of size N/2
+        void transform(complex* data, bool inverse) const
+        {
+            for (size_t i = 0; i < _half; i++)
+                if (i < _bitrev[i])
+                    std::swap(data[i], data[_bitrev[i]]);
+
+            for (size_t length = 2; length <= _half; length <<= 1) {
+                size_t half = length / 2;
+                size_t stride = _half / length;
+
+                for (size_t start = 0; start < _half; start += length) {
+                    for (size_t j = 0; j < half; j++) {
+                        complex w = _twiddles[j * stride];
+                        if (inverse)
+                            w = std::conj(w);
+
+                        complex& a = data[start + j];
+                        complex& b = data[start + j + half];
+                        complex t = mul(w, b);
+
+                        b = a - t;
+                        a = a + t;
+                    }
+                }
+            }
+        }
+    };
+} // namespace fft
+} // namespace wav
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _WAV_FORMAT_H
+#define _WAV_FORMAT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Sample formats of PCM and IEEE float WAVE files
+// Each format names the type samples have in memory (sample_type), how many bytes they take in the file and the
+// 'fmt ' tag identifying it. Every format except S24 is stored exactly as it sits in memory, so it is read,
+// written and mapped without conversion; packed 24-bit samples are widened to 32 bits while being read
+namespace wav {
+namespace format {
+    struct U8 {
+        // Unsigned, 128 is silence
+        using sample_type = uint8_t;
+        static constexpr short tag = 1;
+        static constexpr int bits = 8;
+        static constexpr bool packed = false;
+    };
+
+    struct S16 {
+        using sample_type = short;
+        static constexpr short tag = 1;
+        static constexpr int bits = 16;
+        static constexpr bool packed = false;
+    };
+
+    struct S24 {
+        // Sign-extended into the low 24 bits of an int32_t
+        using sample_type = int32_t;
+        static constexpr short tag = 1;
+        static constexpr int bits = 24;
+        static constexpr bool packed = true;
+
+        static void decode(const char* in, sample_type* out, size_t count)
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+
+            // The three bytes land in the top of the word, the arithmetic shift brings the sign along
+            for (size_t i = 0; i < count; i++, bytes += 3)
+                out[i] = (int32_t)((uint32_t)bytes[0] << 8 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 24) >> 8;
+        }
+
+        // Values beyond 24 bits (e.g. after a gain computed in 32 bits) are saturated rather than wrapped
+        static void encode(const sample_type* in, char* out, size_t count)
+        {
+            for (size_t i = 0; i < count; i++, out += 3) {
+                uint32_t value = (uint32_t)std::clamp<int32_t>(in[i], -(1 << 23), (1 << 23) - 1);
+                out[0] = (char)(value & 0xFF);
+                out[1] = (char)((value >> 8) & 0xFF);
+                out[2] = (char)((value >> 16) & 0xFF);
+            }
+        }
+    };
+
+    struct S32 {
+        using sample_type = int32_t;
+        static constexpr short tag = 1;
+        static constexpr int bits = 32;
+        static constexpr bool packed = false;
+    };
+
+    struct F32 {
+        // Nominally within [-1, 1]
+        using sample_type = float;
+        static constexpr short tag = 3;
+        static constexpr int bits = 32;
+        static constexpr bool packed = false;
+    };
+
+    // Bytes per sample in the file
+    template <typename Format>
+    constexpr size_t stored_bytes = Format::bits / 8;
+} // namespace format
+} // namespace wav
+
+#endif
@@ -0,0 +1,513 @@
+#ifndef _WAV_GENERATOR_H
+#define _WAV_GENERATOR_H
+
+#include "../waveform.hpp"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <vector>
+
+// Test-signal oscillators
+// Every oscillator renders the consecutive blocks of its signal into caller-provided buffers with render(), at
+// amplitudes within [-1, 1]. Phases are derived from the sample index within a block instead of being accumulated
+// sample by sample, and sines come from a polynomial evaluated in SIMD registers (SSE2, AVX2 when available) instead
+// of std::sin. generate() and synthesize() quantize the signal to a sample format
+namespace wav {
+namespace generator {
+    namespace detail {
+        // Adding and subtracting 1.5 * 2^52 rounds a double to the nearest integer (ties to even) without a call
+        constexpr double round_magic = 6755399441055744.0;
+
+        inline double round(double x) { return (x + round_magic) - round_magic; }
+
+        // x - floor(x), in [0, 1)
+        inline double fraction(double x)
+        {
+            double t = x - round(x);
+            return t < 0 ? t + 1 : t;
+        }
+
+        // sin(2 pi x) for |x| < 2^51, within 1e-9
+        inline double sin_cycles(double x)
+        {
+            // Down to a quarter cycle either side of zero, mirroring around +-1/4 where the sine turns
+            double t = x - round(x);
+            double a = std::abs(t);
+            double folded = std::copysign(a > 0.25 ? 0.5 - a : a, t);
+
+            // Taylor series up to the 13th power, the first omitted term is below 7e-10 at pi / 2
+            double theta = 2 * std::numbers::pi_v<double> * folded;
+            double t2 = theta * theta;
+            double p = 1.0 / 6227020800.0;
+            p = p * t2 - 1.0 / 39916800.0;
+            p = p * t2 + 1.0 / 362880.0;
+            p = p * t2 - 1.0 / 5040.0;
+            p = p * t2 + 1.0 / 120.0;
+            p = p * t2 - 1.0 / 6.0;
+
+            return theta + theta * t2 * p;
+        }
+
+#if WAV_SIMD_X86
+        // The same steps as sin_cycles(), two and four doubles at a time; Add accumulates into `out`
+        template <bool Add>
+        void sines_sse2(const double* phases, double* out, size_t count, double amplitude)
+        {
+            const __m128d magic = _mm_set1_pd(round_magic), sign = _mm_set1_pd(-0.0);
+            const __m128d quarter = _mm_set1_pd(0.25), half = _mm_set1_pd(0.5);
+            const __m128d two_pi = _mm_set1_pd(2 * std::numbers::pi_v<double>), gain = _mm_set1_pd(amplitude);
+            size_t i = 0;
+
+            for (; i + 2 <= count; i += 2) {
+                __m128d x = _mm_loadu_pd(phases + i);
+                __m128d t = _mm_sub_pd(x, _mm_sub_pd(_mm_add_pd(x, magic), magic));
+                __m128d a = _mm_andnot_pd(sign, t);
+                __m128d turned = _mm_cmpgt_pd(a, quarter);
+                __m128d folded = _mm_or_pd(_mm_and_pd(turned, _mm_sub_pd(half, a)), _mm_andnot_pd(turned, a));
+
+                __m128d theta = _mm_or_pd(_mm_mul_pd(folded, two_pi), _mm_and_pd(t, sign));
+                __m128d t2 = _mm_mul_pd(theta, theta);
+                __m128d p = _mm_set1_pd(1.0 / 6227020800.0);
+                p = _mm_sub_pd(_mm_mul_pd(p, t2), _mm_set1_pd(1.0 / 39916800.0));
+                p = _mm_add_pd(_mm_mul_pd(p, t2), _mm_set1_pd(1.0 / 362880.0));
+                p = _mm_sub_pd(_mm_mul_pd(p, t2), _mm_set1_pd(1.0 / 5040.0));
+                p = _mm_add_pd(_mm_mul_pd(p, t2), _mm_set1_pd(1.0 / 120.0));
+                p = _mm_sub_pd(_mm_mul_pd(p, t2), _mm_set1_pd(1.0 / 6.0));
+
+                __m128d value = _mm_mul_pd(gain, _mm_add_pd(theta, _mm_mul_pd(_mm_mul_pd(theta, t2), p)));
+                if (Add)
+                    value = _mm_add_pd(value, _mm_loadu_pd(out + i));
+                _mm_storeu_pd(out + i, value);
+            }
+
+            for (; i < count; i++)
+                out[i] = Add ? out[i] + amplitude * sin_cycles(phases[i]) : amplitude * sin_cycles(phases[i]);
+        }
+
+        template <bool Add>
+        WAV_TARGET_AVX2 void sines_avx2(const double* phases, double* out, size_t count, double amplitude)
+        {
+            const __m256d magic = _mm256_set1_pd(round_magic), sign = _mm256_set1_pd(-0.0);
+            const __m256d quarter = _mm256_set1_pd(0.25), half = _mm256_set1_pd(0.5);
+            const __m256d two_pi = _mm256_set1_pd(2 * std::numbers::pi_v<double>), gain = _mm256_set1_pd(amplitude);
+            size_t i = 0;
+
+            for (; i + 4 <= count; i += 4) {
+                __m256d x = _mm256_loadu_pd(phases + i);
+                __m256d t = _mm256_sub_pd(x, _mm256_sub_pd(_mm256_add_pd(x, magic), magic));
+                __m256d a = _mm256_andnot_pd(sign, t);
+                __m256d folded = _mm256_blendv_pd(a, _mm256_sub_pd(half, a), _mm256_cmp_pd(a, quarter, _CMP_GT_OQ));
+
+                __m256d theta = _mm256_or_pd(_mm256_mul_pd(folded, two_pi), _mm256_and_pd(t, sign));
+                __m256d t2 = _mm256_mul_pd(theta, theta);
+                __m256d p = _mm256_set1_pd(1.0 / 6227020800.0);
+                p = _mm256_sub_pd(_mm256_mul_pd(p, t2), _mm256_set1_pd(1.0 / 39916800.0));
+                p = _mm256_add_pd(_mm256_mul_pd(p, t2), _mm256_set1_pd(1.0 / 362880.0));
+                p = _mm256_sub_pd(_mm256_mul_pd(p, t2), _mm256_set1_pd(1.0 / 5040.0));
+                p = _mm256_add_pd(_mm256_mul_pd(p, t2), _mm256_set1_pd(1.0 / 120.0));
+                p = _mm256_sub_pd(_mm256_mul_pd(p, t2), _mm256_set1_pd(1.0 / 6.0));
+
+                __m256d value = _mm256_mul_pd(gain, _mm256_add_pd(theta, _mm256_mul_pd(_mm256_mul_pd(theta, t2), p)));
+                if (Add)
+                    value = _mm256_add_pd(value, _mm256_loadu_pd(out + i));
+                _mm256_storeu_pd(out + i, value);
+            }
+
+            sines_sse2<Add>(phases + i, out + i, count - i, amplitude);
+        }
+#endif
+
+        // out[i] = amplitude * sin(2 pi phases[i]), or added to out[i]; `out` may be `phases`
+        template <bool Add = false>
+        void sines(const double* phases, double* out, size_t count, double amplitude)
+        {
+#if WAV_SIMD_X86
+            if (simd::level() == simd::Level::AVX2)
+                return sines_avx2<Add>(phases, out, count, amplitude);
+
+            return sines_sse2<Add>(phases, out, count, amplitude);
+#else
+            for (size_t i = 0; i < count; i++)
+                out[i] = Add ? out[i] + amplitude * sin_cycles(phases[i]) : amplitude * sin_cycles(phases[i]);
+#endif
+        }
+    } // namespace detail
+
+    // Samples rendered per pass by generate(), and the block size of the oscillators' internal work
+    constexpr size_t block = 1024;
+
+    struct Tone {
+        double frequency;
+        double amplitude = 1.0;
+
+        // Starting phase, in radians
+        double phase = 0.0;
+    };
+
+    // Pure tone
+    class Sine {
+    private:
+        int _sample_rate;
+        double _amplitude;
+
+        // In cycles: the phase of the next sample, in [0, 1), and the advance per sample
+        double _phase;
+        double _increment;
+
+    public:
+        Sine(double frequency, int sample_rate, double amplitude = 1.0, double phase = 0.0)
+            : _sample_rate(sample_rate)
+            , _amplitude(amplitude)
+            , _phase(detail::fraction(phase / (2 * std::numbers::pi_v<double>)))
+            , _increment(frequency / sample_rate)
+        {
+        }
+
+        Sine(const Tone& tone, int sample_rate)
+            : Sine(tone.frequency, sample_rate, tone.amplitude, tone.phase)
+        {
+        }
+
+        int sample_rate() const { return _sample_rate; }
+
+        void render(std::span<double> out) { run<false>(out); }
+
+        // Adds the tone to what `out` already holds
+        void mix(std::span<double> out) { run<true>(out); }
+
+    private:
+        template <bool Add>
+        void run(std::span<double> out)
+        {
+            // Phases restart from the reduced phase every block, so they stay small and exact however long the
+            // signal runs
+            std::array<double, block> phases;
+
+            for (size_t first = 0; first < out.size(); first += block) {
+                size_t count = std::min(block, out.size() - first);
+
+                for (size_t i = 0; i < count; i++)
+                    phases[i] = _phase + (double)i * _increment;
+                detail::sines<Add>(phases.data(), out.data() + first, count, _amplitude);
+
+                _phase = detail::fraction(_phase + (double)count * _increment);
+            }
+        }
+    };
+
+    // Sum of pure tones, e.g. for intermodulation tests; the amplitudes are not rescaled
+    class MultiTone {
+    private:
+        int _sample_rate;
+        std::vector<Sine> _tones;
+
+    public:
+        MultiTone(const std::vector<Tone>& tones, int sample_rate)
+            : _sample_rate(sample_rate)
+        {
+            for (const Tone& tone : tones)
+                _tones.emplace_back(tone, sample_rate);
+        }
+
+        int sample_rate() const { return _sample_rate; }
+
+        void render(std::span<double> out)
+        {
+            std::fill(out.begin(), out.end(), 0.0);
+            for (Sine& tone : _tones)
+                tone.mix(out);
+        }
+    };
+
+    // Square wave, high for the first `duty` of every cycle
+    // Square and saw waves are computed exactly (not band-limited), like a function generator's output, so
+    // harmonics above Nyquist fold back
+    class Square {
+    private:
+        int _sample_rate;
+        double _amplitude;
+        double _duty;
+        double _phase;
+        double _increment;
+
+    public:
+        Square(double frequency, int sample_rate, double amplitude = 1.0, double duty = 0.5)
+            : _sample_rate(sample_rate)
+            , _amplitude(amplitude)
+            , _duty(duty)
+            , _phase(0.0)
+            , _increment(frequency / sample_rate)
+        {
+        }
+
+        int sample_rate() const { return _sample_rate; }
+
+        void render(std::span<double> out)
+        {
+            for (size_t first = 0; first < out.size(); first += block) {
+                size_t count = std::min(block, out.size() - first);
+                double* target = out.data() + first;
+
+                for (size_t i = 0; i < count; i++)
+                    target[i] = detail::fraction(_phase + (double)i * _increment) < _duty ? _amplitude : -_amplitude;
+
+                _phase = detail::fraction(_phase + (double)count * _increment);
+            }
+        }
+    };
+
+    // Rising sawtooth, from -amplitude to amplitude every cycle
+    class Saw {
+    private:
+        int _sample_rate;
+        double _amplitude;
+        double _phase;
+        double _increment;
+
+    public:
+        Saw(double frequency, int sample_rate, double amplitude = 1.0)
+            : _sample_rate(sample_rate)
+            , _amplitude(amplitude)
+            , _phase(0.5)
+            , _increment(frequency / sample_rate)
+        {
+        }
+
+        int sample_rate() const { return _sample_rate; }
+
+        void render(std::span<double> out)
+        {
+            for (size_t first = 0; first < out.size(); first += block) {
+                size_t count = std::min(block, out.size() - first);
+                double* target = out.data() + first;
+
+                for (size_t i = 0; i < count; i++)
+                    target[i] = _amplitude * (2 * detail::fraction(_phase + (double)i * _increment) - 1);
+
+                _phase = detail::fraction(_phase + (double)count * _increment);
+            }
+        }
+    };
+
+    // Noise from a seeded generator, so a corpus can be regenerated bit for bit
+    // White noise is uniform within [-amplitude, amplitude]; pink noise falls off by 3 dB per octave (Paul
+    // Kellet's filter over white noise) and peaks around the amplitude
+    class Noise {
+    public:
+        enum class Color {
+            White,
+            Pink
+        };
+
+    private:
+        int _sample_rate;
+        double _amplitude;
+        Color _color;
+        uint64_t _state;
+
+        // Pink noise filter state
+        std::array<double, 7> _pink {};
+
+    public:
+        Noise(int sample_rate, double amplitude = 1.0, Color color = Color::White, uint64_t seed = 0x2545F4914F6CDD1Dull)
+            : _sample_rate(sample_rate)
+            , _amplitude(amplitude)
+            , _color(color)
+            , _state(seed)
+        {
+        }
+
+        int sample_rate() const { return _sample_rate; }
+
+        void render(std::span<double> out)
+        {
+            for (double& sample : out)
+                sample = uniform();
+
+            if (_color == Color::White) {
+                for (double& sample : out)
+                    sample *= _amplitude;
+                return;
+            }
+
+            std::array<double, 7>& b = _pink;
+            for (double& sample : out) {
+                double white = sample;
+
+                b[0] = 0.99886 * b[0] + white * 0.0555179;
+                b[1] = 0.99332 * b[1] + white * 0.0750759;
+                b[2] = 0.96900 * b[2] + white * 0.1538520;
+                b[3] = 0.86650 * b[3] + white * 0.3104856;
+                b[4] = 0.55000 * b[4] + white * 0.5329522;
+                b[5] = -0.7616 * b[5] - white * 0.0168980;
+
+                // The sum peaks near 10 for uniform input within [-1, 1]
+                sample = _amplitude * 0.1 * (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362);
+                b[6] = white * 0.115926;
+            }
+        }
+
+    private:
+        // splitmix64, uniform within [-1, 1)
+        double uniform()
+        {
+            uint64_t z = (_state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+
+            return (double)(z >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+        }
+    };
+
+    // Sine sweeping from one frequency to another over `duration` seconds, and staying at the final one afterwards
+    // Linear sweeps change frequency at a constant rate, exponential (logarithmic) ones spend the same time on
+    // every octave (both frequencies must then be above zero)
+    class Sweep {
+    public:
+        enum class Shape {
+            Linear,
+            Exponential
+        };
+
+    private:
+        int _sample_rate;
+        double _amplitude;
+        Shape _shape;
+
+        // In cycles per sample
+        double _from, _to;
+
+        size_t _length;
+        size_t _position = 0;
+        double _phase = 0.0;
+
+    public:
+        Sweep(double from, double to, double duration, int sample_rate, double amplitude = 1.0,
+            Shape shape = Shape::Exponential)
+            : _sample_rate(sample_rate)
+            , _amplitude(amplitude)
+            , _shape(shape)
+            , _from(from / sample_rate)
+            , _to(to / sample_rate)
+            , _length((size_t)std::max(duration * sample_rate, 1.0))
+        {
+        }
+
+        int sample_rate() const { return _sample_rate; }
+
+        void render(std::span<double> out)
+        {
+            for (size_t first = 0; first < out.size(); first += block) {
+                size_t count = std::min(block, out.size() - first);
+
+                // The frequency is recomputed from the position at the start of every block and advanced by a
+                // constant step (or factor) within it, so rounding never accumulates over the sweep
+                double increment = frequency(_position);
+                double step = _shape == Shape::Linear ? (_to - _from) / _length : std::pow(_to / _from, 1.0 / _length);
+                double* phases = out.data() + first;
+
+                for (size_t i = 0; i < count; i++) {
+                    phases[i] = _phase;
+                    _phase += increment;
+
+                    if (_position + i < _length)
+                        increment = _shape == Shape::Linear ? increment + step : increment * step;
+                }
+
+                detail::sines(phases, phases, count, _amplitude);
+
+                _phase = detail::fraction(_phase);
+                _position += count;
+            }
+        }
+
+    private:
+        // Cycles per sample at sample `position`
+        double frequency(size_t position) const
+        {
+            double progress = std::min((double)position / _length, 1.0);
+
+            if (_shape == Shape::Linear)
+                return _from + (_to - _from) * progress;
+
+            return _from * std::pow(_to / _from, progress);
+        }
+    };
+
+    // Oscillators render blocks of doubles within [-1, 1] and know their sample rate
+    template <typename Generator>
+    concept Oscillator = requires(Generator& generator, std::span<double> out) {
+        generator.render(out);
+        { generator.sample_rate() } -> std::convertible_to<int>;
+    };
+
+    // Scales `in` from [-1, 1] to the full range of the sample format, rounding to the nearest step and saturating
+    template <typename Format>
+    void quantize(std::span<const double> in, typename Format::sample_type* out)
+    {
+        using sample_type = typename Format::sample_type;
+
+        if constexpr (std::is_floating_point_v<sample_type>) {
+            for (size_t i = 0; i < in.size(); i++)
+                out[i] = (sample_type)in[i];
+        } else if constexpr (std::is_unsigned_v<sample_type>) {
+            // Unsigned 8-bit, 128 is silence
+            for (size_t i = 0; i < in.size(); i++)
+                out[i] = (sample_type)(128 + detail::round(std::clamp(in[i], -1.0, 1.0) * 127));
+        } else {
+            constexpr double full_scale = (double)((1ll << (Format::bits - 1)) - 1);
+            for (size_t i = 0; i < in.size(); i++)
+                out[i] = (sample_type)detail::round(std::clamp(in[i], -1.0, 1.0) * full_scale);
+        }
+    }
+
+    // Renders out.size() / channels frames into `out`, interleaved, with the same signal on every channel
+    template <typename Format = format::S16, Oscillator Generator>
+    void generate(Generator& generator, std::span<typename Format::sample_type> out, int channels = 1)
+    {
+        using sample_type = typename Format::sample_type;
+
+        std::array<double, block> signal;
+        std::array<sample_type, block> quantized;
+
+        size_t frames = out.size() / std::max(channels, 1);
+        for (size_t first = 0; first < frames; first += block) {
+            size_t count = std::min(block, frames - first);
+            std::span<double> part(signal.data(), count);
+
+            generator.render(part);
+
+            if (channels <= 1) {
+                quantize<Format>(part, out.data() + first);
+                continue;
+            }
+
+            quantize<Format>(part, quantized.data());
+            sample_type* frame = out.data() + first * channels;
+            for (size_t i = 0; i < count; i++, frame += channels)
+                std::fill_n(frame, channels, quantized[i]);
+        }
+    }
+
+    // Waveform holding `seconds` of the generator's signal, ready to be saved
+    template <typename Format = format::S16, Oscillator Generator>
+    BasicWaveform<Format> synthesize(Generator& generator, double seconds, int channels = 1)
+    {
+        BasicWaveform<Format> waveform;
+        waveform.header() = make_header<Format>(generator.sample_rate(), channels);
+
+        size_t frames = (size_t)std::max(seconds * generator.sample_rate(), 0.0);
+        auto& samples = waveform.data();
+        samples.resize(frames * channels);
+        generate<Format>(generator, std::span<typename Format::sample_type>(samples), channels);
+
+        waveform.header().subchunk2_size = (int)(samples.size() * format::stored_bytes<Format>);
+        return waveform;
+    }
+} // namespace generator
+} // namespace wav
+
+#endif
@@ -0,0 +1,440 @@
+#ifndef _WAV_IIR_H
+#define _WAV_IIR_H
+
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Biquad (second-order IIR) filters, designed with the Audio EQ Cookbook formulas and run as cascades of sections in
+// transposed direct form II
+// A few sections shape a spectrum that would take an FIR kernel hundreds or thousands of taps (a highpass at 40 Hz,
+// a shelf, a narrow peak), at five multiplications per section and sample
+namespace wav {
+namespace iir {
+    // Normalized so that a0 = 1: y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+    struct Coefficients {
+        double b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+
+        // Gain (not in dB) at `frequency`, for samples taken at `rate`
+        double magnitude(double frequency, double rate) const
+        {
+            std::complex<double> z = std::polar(1.0, -2 * std::numbers::pi_v<double> * frequency / rate);
+            return std::abs((b0 + (b1 + b2 * z) * z) / (1.0 + (a1 + a2 * z) * z));
+        }
+    };
+
+    enum class Shape {
+        Lowpass,
+        Highpass,
+        Bandpass,
+        Notch,
+        Peaking,
+        LowShelf,
+        HighShelf
+    };
+
+    // Q of a maximally flat (Butterworth) second-order section; for shelves, the steepest slope without overshoot
+    constexpr double butterworth = std::numbers::sqrt2_v<double> / 2;
+
+    struct Section {
+        Shape shape = Shape::Lowpass;
+        double frequency = 1000; // cut-off, centre or shelf midpoint, in Hz
+        double q = butterworth;
+        double gain = 0; // in dB, for peaking and shelving sections only
+
+        // Throws std::invalid_argument unless 0 < frequency < rate / 2 and q > 0
+        Coefficients design(double rate) const
+        {
+            if (frequency <= 0 || frequency >= rate / 2 || q <= 0)
+                throw std::invalid_argument("Biquad section needs 0 < frequency < rate / 2 and q > 0.");
+
+            double w = 2 * std::numbers::pi_v<double> * frequency / rate;
+            double cosine = std::cos(w);
+            double alpha = std::sin(w) / (2 * q);
+            double A = std::pow(10.0, gain / 40);
+            double root = 2 * std::sqrt(A) * alpha;
+
+            double b0, b1, b2, a0, a1, a2;
+            switch (shape) {
+            case Shape::Lowpass:
+                b0 = b2 = (1 - cosine) / 2;
+                b1 = 1 - cosine;
+                a0 = 1 + alpha, a1 = -2 * cosine, a2 = 1 - alpha;
+                break;
+            case Shape::Highpass:
+                b0 = b2 = (1 + cosine) / 2;
+                b1 = -(1 + cosine);
+                a0 = 1 + alpha, a1 = -2 * cosine, a2 = 1 - alpha;
+                break;
+            case Shape::Bandpass:
+                // Unity gain at the centre
+                b0 = alpha, b1 = 0, b2 = -alpha;
+                a0 = 1 + alpha, a1 = -2 * cosine, a2 = 1 - alpha;
+                break;
+            case Shape::Notch:
+                b0 = b2 = 1;
+                b1 = -2 * cosine;
+                a0 = 1 + alpha, a1 = -2 * cosine, a2 = 1 - alpha;
+                break;
+            case Shape::Peaking:
+                b0 = 1 + alpha * A, b1 = -2 * cosine, b2 = 1 - alpha * A;
+                a0 = 1 + alpha / A, a1 = -2 * cosine, a2 = 1 - alpha / A;
+                break;
+            case Shape::LowShelf:
+                b0 = A * ((A + 1) - (A - 1) * cosine + root);
+                b1 = 2 * A * ((A - 1) - (A + 1) * cosine);
+                b2 = A * ((A + 1) - (A - 1) * cosine - root);
+                a0 = (A + 1) + (A - 1) * cosine + root;
+                a1 = -2 * ((A - 1) + (A + 1) * cosine);
+                a2 = (A + 1) + (A - 1) * cosine - root;
+                break;
+            case Shape::HighShelf:
+            default:
+                b0 = A * ((A + 1) + (A - 1) * cosine + root);
+                b1 = -2 * A * ((A - 1) + (A + 1) * cosine);
+                b2 = A * ((A + 1) + (A - 1) * cosine - root);
+                a0 = (A + 1) - (A - 1) * cosine + root;
+                a1 = 2 * ((A - 1) - (A + 1) * cosine);
+                a2 = (A + 1) - (A - 1) * cosine - root;
+                break;
+            }
+
+            return { b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0 };
+        }
+    };
+
+    // Sections applied one after another, described by frequency rather than coefficients, so one cascade serves
+    // files of any sample rate: iir::Cascade().highpass(80).peaking(3000, -4, 2).high_shelf(10000, 2)
+    class Cascade {
+    private:
+        std::vector<Section> _sections;
+
+    public:
+        Cascade& add(const Section& section)
+        {
+            _sections.push_back(section);
+            return *this;
+        }
+
+        Cascade& lowpass(double frequency, double q = butterworth) { return add({ Shape::Lowpass, frequency, q }); }
+        Cascade& highpass(double frequency, double q = butterworth) { return add({ Shape::Highpass, frequency, q }); }
+        Cascade& bandpass(double frequency, double q = 1) { return add({ Shape::Bandpass, frequency, q }); }
+        Cascade& notch(double frequency, double q = 10) { return add({ Shape::Notch, frequency, q }); }
+        Cascade& peaking(double frequency, double gain, double q = 1)
+        {
+            return add({ Shape::Peaking, frequency, q, gain });
+        }
+        Cascade& low_shelf(double frequency, double gain, double q = butterworth)
+        {
+            return add({ Shape::LowShelf, frequency, q, gain });
+        }
+        Cascade& high_shelf(double frequency, double gain, double q = butterworth)
+        {
+            return add({ Shape::HighShelf, frequency, q, gain });
+        }
+
+        // Butterworth lowpass or highpass of an even `order`, as order / 2 sections; 12 dB per octave and section
+        Cascade& butterworth_lowpass(double frequency, int order)
+        {
+            return butterworth_sections(Shape::Lowpass, frequency, order);
+        }
+        Cascade& butterworth_highpass(double frequency, int order)
+        {
+            return butterworth_sections(Shape::Highpass, frequency, order);
+        }
+
+        const std::vector<Section>& sections() const { return _sections; }
+        bool empty() const { return _sections.empty(); }
+
+        std::vector<Coefficients> design(double rate) const
+        {
+            std::vector<Coefficients> coefficients;
+            for (const Section& section : _sections)
+                coefficients.push_back(section.design(rate));
+
+            return coefficients;
+        }
+
+        // Gain (not in dB) of the whole cascade at `frequency`
+        double magnitude(double frequency, double rate) const
+        {
+            double product = 1;
+            for (const Coefficients& section : design(rate))
+                product *= section.magnitude(frequency, rate);
+
+            return product;
+        }
+
+    private:
+        Cascade& butterworth_sections(Shape shape, double frequency, int order)
+        {
+            // Pole pairs of the Butterworth polynomial, the k-th section has Q = 1 / (2 cos((2k + 1) pi / 2n))
+            int n = std::max(order, 2);
+            for (int k = 0; k < n / 2; k++)
+                add({ shape, frequency, 1 / (2 * std::cos((2 * k + 1) * std::numbers::pi_v<double> / (2 * n))) });
+
+            return *this;
+        }
+    };
+
+    // Arithmetic the filter state is kept in; double for sections far below the sample rate, where float rounding
+    // starts to show as noise
+    enum class Precision {
+        Float,
+        Double
+    };
+
+    namespace detail {
+        // Denormal numbers (the decaying tail of a filter fed silence) take a slow path through the FPU; flushing
+        // them to zero while filtering changes the output by less than 1e-30
+        class DenormalGuard {
+#if WAV_SIMD_X86
+        private:
+            unsigned int _csr;
+
+        public:
+            DenormalGuard()
+                : _csr(_mm_getcsr())
+            {
+                // Flush-to-zero and denormals-are-zero
+                _mm_setcsr(_csr | 0x8040);
+            }
+            ~DenormalGuard() { _mm_setcsr(_csr); }
+#endif
+        };
+
+        // Rounded to nearest (ties to even, like std::lrint) and saturated
+        template <typename T>
+        inline short quantize(T value)
+        {
+            value = std::clamp(value, (T)std::numeric_limits<short>::min(), (T)std::numeric_limits<short>::max());
+#if WAV_SIMD_X86
+            // std::lrint is a library call unless errno handling is turned off
+            if constexpr (std::is_same_v<T, float>)
+                return (short)_mm_cvtss_si32(_mm_set_ss(value));
+            else
+                return (short)_mm_cvtsd_si32(_mm_set_sd(value));
+#else
+            return (short)std::lrint(value);
+#endif
+        }
+    } // namespace detail
+
+    // A cascade designed for one sample rate, run over interleaved 16-bit frames of `channels` channels
+    // Every channel keeps its state from one block to the next, so a signal filtered block by block (e.g. by
+    // wav::Stream) comes out as if it had been filtered whole. Blocks must hold whole frames
+    // Frames are filtered in tiles, channel by channel and section by section. With float state on x86-64, four
+    // sections of a channel run together in one SSE register, each one sample behind the section before it
+    template <typename T = float>
+    class Filter {
+    public:
+        static constexpr bool sequential = true;
+
+        // Frames per tile, small enough for a channel's tile to stay in L1 while every section runs over it
+        static constexpr size_t tile = 1024;
+
+    private:
+        static constexpr size_t lanes = 4;
+
+        int _channels;
+        size_t _sections;
+        size_t _groups;
+
+        // Per group of four sections: b0, b1, b2, a1 and a2 of each, padded with pass-through sections
+        std::vector<T> _coefficients;
+
+        // Per channel and group: s1 and s2 of each section
+        std::vector<T> _state;
+        std::vector<T> _buffer;
+
+    public:
+        Filter(const Cascade& cascade, double rate, int channels = 1)
+            : _channels(std::max(channels, 1))
+            , _sections(cascade.sections().size())
+            , _groups((_sections + lanes - 1) / lanes)
+            , _coefficients(_groups * 5 * lanes, (T)0)
+            , _state(_channels * _groups * 2 * lanes, (T)0)
+            , _buffer(tile)
+        {
+            auto sections = cascade.design(rate);
+
+            for (size_t group = 0; group < _groups; group++) {
+                T* c = &_coefficients[group * 5 * lanes];
+
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    size_t index = group * lanes + lane;
+                    Coefficients section = index < _sections ? sections[index] : Coefficients {};
+
+                    c[lane] = (T)section.b0;
+                    c[lanes + lane] = (T)section.b1;
+                    c[2 * lanes + lane] = (T)section.b2;
+                    c[3 * lanes + lane] = (T)section.a1;
+                    c[4 * lanes + lane] = (T)section.a2;
+                }
+            }
+        }
+
+        int channels() const { return _channels; }
+
+        // Forget everything seen so far, as if the next block started the signal
+        void reset() { std::fill(_state.begin(), _state.end(), (T)0); }
+
+        void process(std::span<short> samples)
+        {
+            if (_sections == 0)
+                return;
+
+            detail::DenormalGuard guard;
+            size_t frames = samples.size() / _channels;
+
+            for (size_t first = 0; first < frames; first += tile) {
+                size_t count = std::min(tile, frames - first);
+
+                for (int channel = 0; channel < _channels; channel++) {
+                    short* base = samples.data() + first * _channels + channel;
+
+                    load(base, count);
+                    for (size_t group = 0; group < _groups; group++)
+                        run(group, &_state[((size_t)channel * _groups + group) * 2 * lanes], count);
+                    store(base, count);
+                }
+            }
+        }
+
+    private:
+        // Samples of one channel into the buffer and back, eight at a time when they are contiguous
+        void load(const short* samples, size_t count)
+        {
+            size_t i = 0;
+#if WAV_SIMD_X86
+            if constexpr (std::is_same_v<T, float>) {
+                for (; _channels == 1 && i + 8 <= count; i += 8) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+                    _mm_storeu_ps(&_buffer[i], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+                    _mm_storeu_ps(&_buffer[i + 4], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)));
+                }
+            }
+#endif
+            for (; i < count; i++)
+                _buffer[i] = (T)samples[i * _channels];
+        }
+
+        void store(short* samples, size_t count) const
+        {
+            size_t i = 0;
+#if WAV_SIMD_X86
+            if constexpr (std::is_same_v<T, float>) {
+                // Clamped first, out-of-range conversions would wrap; the pack saturates what is left
+                const __m128 low = _mm_set1_ps(-32768.0f), high = _mm_set1_ps(32767.0f);
+                for (; _channels == 1 && i + 8 <= count; i += 8) {
+                    __m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(&_buffer[i]), low), high));
+                    __m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(&_buffer[i + 4]), low), high));
+                    _mm_storeu_si128((__m128i*)(samples + i), _mm_packs_epi32(a, b));
+                }
+            }
+#endif
+            for (; i < count; i++)
+                samples[i * _channels] = detail::quantize(_buffer[i]);
+        }
+
+        void run(size_t group, T* state, size_t count)
+        {
+#if WAV_SIMD_X86
+            if constexpr (std::is_same_v<T, float>) {
+                // A single section has nothing to overlap with
+                if (_sections > 1) {
+                    pipelined(&_coefficients[group * 5 * lanes], state, count);
+                    return;
+                }
+            }
+#endif
+            size_t used = std::min(lanes, _sections - group * lanes);
+            for (size_t lane = 0; lane < used; lane++)
+                section(&_coefficients[group * 5 * lanes + lane], state + lane, count);
+        }
+
+        // One section over the buffer, coefficients and state `lanes` apart
+        void section(const T* c, T* state, size_t count)
+        {
+            T b0 = c[0], b1 = c[lanes], b2 = c[2 * lanes], a1 = c[3 * lanes], a2 = c[4 * lanes];
+            T s1 = state[0], s2 = state[lanes];
+
+            for (size_t i = 0; i < count; i++) {
+                T x = _buffer[i];
+                T y = b0 * x + s1;
+
+                // Terms not involving y first, which keeps the dependency chain from one sample to the next short
+                s1 = (b1 * x + s2) - a1 * y;
+                s2 = b2 * x - a2 * y;
+                _buffer[i] = y;
+            }
+
+            state[0] = s1;
+            state[lanes] = s2;
+        }
+
+#if WAV_SIMD_X86
+        // Four sections in the lanes of one register: at step t lane 0 takes sample t, lane k the output of lane
+        // k - 1 from step t - 1, and lane 3 hands out the result for sample t - 3
+        // The first and last three steps of a tile fill and drain the pipeline, lanes without a sample of their
+        // own keep their state, so every section ends the tile having seen exactly the tile's samples
+        void pipelined(const float* c, float* state, size_t count)
+        {
+            const __m128 b0 = _mm_loadu_ps(c), b1 = _mm_loadu_ps(c + lanes), b2 = _mm_loadu_ps(c + 2 * lanes);
+            const __m128 a1 = _mm_loadu_ps(c + 3 * lanes), a2 = _mm_loadu_ps(c + 4 * lanes);
+            const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+            __m128 s1 = _mm_loadu_ps(state), s2 = _mm_loadu_ps(state + lanes);
+            __m128 y = _mm_setzero_ps();
+            float* buffer = _buffer.data();
+
+            auto step = [&](size_t t, bool masked) {
+                float x = t < count ? buffer[t] : 0.0f;
+                __m128 in = _mm_move_ss(_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(y), 4)), _mm_set_ss(x));
+
+                y = _mm_add_ps(_mm_mul_ps(b0, in), s1);
+                __m128 n1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(b1, in), s2), _mm_mul_ps(a1, y));
+                __m128 n2 = _mm_sub_ps(_mm_mul_ps(b2, in), _mm_mul_ps(a2, y));
+
+                if (masked) {
+                    // Lane k holds a sample when t - count < k <= t
+                    __m128 valid = _mm_and_ps(_mm_cmple_ps(lane, _mm_set1_ps((float)t)),
+                        _mm_cmpgt_ps(lane, _mm_set1_ps((float)t - (float)count)));
+
+                    n1 = _mm_or_ps(_mm_and_ps(valid, n1), _mm_andnot_ps(valid, s1));
+                    n2 = _mm_or_ps(_mm_and_ps(valid, n2), _mm_andnot_ps(valid, s2));
+                }
+
+                s1 = n1;
+                s2 = n2;
+
+                if (t >= lanes - 1)
+                    buffer[t - (lanes - 1)] = _mm_cvtss_f32(_mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 3, 3)));
+            };
+
+            size_t steps = count + lanes - 1;
+            size_t t = 0;
+            for (; t < std::min(lanes - 1, steps); t++)
+                step(t, true);
+            for (; t < count; t++)
+                step(t, false);
+            for (; t < steps; t++)
+                step(t, true);
+
+            _mm_storeu_ps(state, s1);
+            _mm_storeu_ps(state + lanes, s2);
+        }
+#endif
+    };
+} // namespace iir
+} // namespace wav
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef _WAV_INTERLEAVE_H
+#define _WAV_INTERLEAVE_H
+
+#include "simd.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Conversion between the interleaved layout of WAVE files (L R L R ...) and one contiguous buffer per channel
+// Stereo 16-bit and 32-bit samples, by far the most common, use SSE2 shuffles; other channel counts up to 8 get a
+// loop specialized for the count, which the compiler unrolls, and anything above falls back to a generic loop
+namespace wav {
+namespace simd {
+    namespace detail {
+        template <int Channels, typename T>
+        void deinterleave_fixed(const T* in, size_t frames, T* const* out)
+        {
+            for (size_t frame = 0; frame < frames; frame++, in += Channels)
+                for (int channel = 0; channel < Channels; channel++)
+                    out[channel][frame] = in[channel];
+        }
+
+        template <int Channels, typename T>
+        void interleave_fixed(const T* const* in, size_t frames, T* out)
+        {
+            for (size_t frame = 0; frame < frames; frame++, out += Channels)
+                for (int channel = 0; channel < Channels; channel++)
+                    out[channel] = in[channel][frame];
+        }
+
+#if WAV_SIMD_X86
+        inline void deinterleave_stereo(const short* in, size_t frames, short* left, short* right)
+        {
+            size_t frame = 0;
+
+            for (; frame + 8 <= frames; frame += 8) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(in + 2 * frame));
+                __m128i b = _mm_loadu_si128((const __m128i*)(in + 2 * frame + 8));
+
+                // Each 32-bit lane holds one frame; sign-extend its halves and pack them back to 16 bits
+                __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+                __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+
+                _mm_storeu_si128((__m128i*)(left + frame), l);
+                _mm_storeu_si128((__m128i*)(right + frame), r);
+            }
+
+            for (; frame < frames; frame++) {
+                left[frame] = in[2 * frame];
+                right[frame] = in[2 * frame + 1];
+            }
+        }
+
+        inline void interleave_stereo(const short* left, const short* right, size_t frames, short* out)
+        {
+            size_t frame = 0;
+
+            for (; frame + 8 <= frames; frame += 8) {
+                __m128i l = _mm_loadu_si128((const __m128i*)(left + frame));
+                __m128i r = _mm_loadu_si128((const __m128i*)(right + frame));
+
+                _mm_storeu_si128((__m128i*)(out + 2 * frame), _mm_unpacklo_epi16(l, r));
+                _mm_storeu_si128((__m128i*)(out + 2 * frame + 8), _mm_unpackhi_epi16(l, r));
+            }
+
+            for (; frame < frames; frame++) {
+                out[2 * frame] = left[frame];
+                out[2 * frame + 1] = right[frame];
+            }
+        }
+
+        // 32-bit samples of any type, moved through float registers (shuffles leave the bit patterns untouched)
+        template <typename T>
+        void deinterleave_stereo32(const T* in, size_t frames, T* left, T* right)
+        {
+            size_t frame = 0;
+
+            for (; frame + 4 <= frames; frame += 4) {
+                __m128 a = _mm_loadu_ps((const float*)(in + 2 * frame)), b = _mm_loadu_ps((const float*)(in + 2 * frame + 4));
+
+                _mm_storeu_ps((float*)(left + frame), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps((float*)(right + frame), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+
+            for (; frame < frames; frame++) {
+                left[frame] = in[2 * frame];
+                right[frame] = in[2 * frame + 1];
+            }
+        }
+
+        template <typename T>
+        void interleave_stereo32(const T* left, const T* right, size_t frames, T* out)
+        {
+            size_t frame = 0;
+
+            for (; frame + 4 <= frames; frame += 4) {
+                __m128 l = _mm_loadu_ps((const float*)(left + frame)), r = _mm_loadu_ps((const float*)(right + frame));
+
+                _mm_storeu_ps((float*)(out + 2 * frame), _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps((float*)(out + 2 * frame + 4), _mm_unpackhi_ps(l, r));
+            }
+
+            for (; frame < frames; frame++) {
+                out[2 * frame] = left[frame];
+                out[2 * frame + 1] = right[frame];
+            }
+        }
+#endif
+    } // namespace detail
+
+    // out[channel][frame] = in[frame * channels + channel]
+    template <typename T>
+    void deinterleave(const T* in, size_t frames, int channels, T* const* out)
+    {
+#if WAV_SIMD_X86
+        if (channels == 2) {
+            if constexpr (sizeof(T) == 2 && std::is_integral_v<T>)
+                return detail::deinterleave_stereo((const short*)in, frames, (short*)out[0], (short*)out[1]);
+            if constexpr (sizeof(T) == 4)
+                return detail::deinterleave_stereo32(in, frames, out[0], out[1]);
+        }
+#endif
+
+        switch (channels) {
+        case 1:
+            if (frames > 0)
+                memcpy(out[0], in, frames * sizeof(T));
+            return;
+        case 2:
+            return detail::deinterleave_fixed<2>(in, frames, out);
+        case 3:
+            return detail::deinterleave_fixed<3>(in, frames, out);
+        case 4:
+            return detail::deinterleave_fixed<4>(in, frames, out);
+        case 5:
+            return detail::deinterleave_fixed<5>(in, frames, out);
+        case 6:
+            return detail::deinterleave_fixed<6>(in, frames, out);
+        case 7:
+            return detail::deinterleave_fixed<7>(in, frames, out);
+        case 8:
+            return detail::deinterleave_fixed<8>(in, frames, out);
+        default:
+            for (size_t frame = 0; frame < frames; frame++)
+                for (int channel = 0; channel < channels; channel++)
+                    out[channel][frame] = in[frame * channels + channel];
+        }
+    }
+
+    // out[frame * channels + channel] = in[channel][frame]
+    template <typename T>
+    void interleave(const T* const* in, size_t frames, int channels, T* out)
+    {
+#if WAV_SIMD_X86
+        if (channels == 2) {
+            if constexpr (sizeof(T) == 2 && std::is_integral_v<T>)
+                return detail::interleave_stereo((const short*)in[0], (const short*)in[1], frames, (short*)out);
+            if constexpr (sizeof(T) == 4)
+                return detail::interleave_stereo32(in[0], in[1], frames, out);
+        }
+#endif
+
+        switch (channels) {
+        case 1:
+            if (frames > 0)
+                memcpy(out, in[0], frames * sizeof(T));
+            return;
+        case 2:
+            return detail::interleave_fixed<2>(in, frames, out);
+        case 3:
+            return detail::interleave_fixed<3>(in, frames, out);
+        case 4:
+            return detail::interleave_fixed<4>(in, frames, out);
+        case 5:
+            return detail::interleave_fixed<5>(in, frames, out);
+        case 6:
+            return detail::interleave_fixed<6>(in, frames, out);
+        case 7:
+            return detail::interleave_fixed<7>(in, frames, out);
+        case 8:
+            return detail::interleave_fixed<8>(in, frames, out);
+        default:
+            for (size_t frame = 0; frame < frames; frame++)
+                for (int channel = 0; channel < channels; channel++)
+                    out[frame * channels + channel] = in[channel][frame];
+        }
+    }
+} // namespace simd
+} // namespace wav
+
+#endif
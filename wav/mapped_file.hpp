@@ -0,0 +1,205 @@
+#ifndef _WAV_MAPPED_FILE_H
+#define _WAV_MAPPED_FILE_H
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace wav {
+
+// Memory mapping of a whole file, either read-only (existing file) or read/write (newly created, pre-sized file)
+// The mapping is released when the object goes out of scope; pointers into it must not outlive it
+class MappedFile {
+private:
+    std::string _path;
+    char* _base = nullptr;
+    size_t _size = 0;
+
+#if defined(_WIN32)
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = NULL;
+#endif
+
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& filename)
+        : _path(filename)
+    {
+#if defined(_WIN32)
+        _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Specified file could not be opened.");
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(_file, &size) == FALSE) {
+            release();
+            throw std::runtime_error("Specified file could not be inspected.");
+        }
+        _size = static_cast<size_t>(size.QuadPart);
+
+        // Zero-length views cannot be mapped, an empty file simply has no base
+        if (_size == 0)
+            return;
+
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (_mapping != NULL)
+            _base = static_cast<char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+
+        if (_base == nullptr) {
+            release();
+            throw std::runtime_error("Specified file could not be memory-mapped.");
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Specified file could not be opened.");
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Specified file could not be inspected.");
+        }
+        _size = static_cast<size_t>(info.st_size);
+
+        if (_size != 0) {
+            void* base = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (base == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Specified file could not be memory-mapped.");
+            }
+
+            _base = static_cast<char*>(base);
+            ::madvise(_base, _size, MADV_SEQUENTIAL);
+        }
+
+        // The mapping keeps its own reference to the file
+        ::close(fd);
+#endif
+    }
+
+    // Creates (or truncates) the file, resizes it to exactly `size` bytes and maps it for writing
+    MappedFile(const std::string& filename, size_t size)
+        : _path(filename)
+        , _size(size)
+    {
+#if defined(_WIN32)
+        _file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Specified file could not be created.");
+
+        if (_size == 0)
+            return;
+
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(_size);
+        if (SetFilePointerEx(_file, end, NULL, FILE_BEGIN) == FALSE || SetEndOfFile(_file) == FALSE) {
+            release();
+            throw std::runtime_error("Specified file could not be resized.");
+        }
+
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_READWRITE, 0, 0, NULL);
+        if (_mapping != NULL)
+            _base = static_cast<char*>(MapViewOfFile(_mapping, FILE_MAP_WRITE, 0, 0, 0));
+
+        if (_base == nullptr) {
+            release();
+            throw std::runtime_error("Specified file could not be memory-mapped.");
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Specified file could not be created.");
+
+        if (_size != 0) {
+            if (::ftruncate(fd, static_cast<off_t>(_size)) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Specified file could not be resized.");
+            }
+
+            void* base = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Specified file could not be memory-mapped.");
+            }
+
+            _base = static_cast<char*>(base);
+        }
+
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { swap(other); }
+
+    MappedFile& operator=(MappedFile&& rhs) noexcept
+    {
+        if (this != &rhs) {
+            release();
+            swap(rhs);
+        }
+
+        return *this;
+    }
+
+    ~MappedFile() { release(); }
+
+    char* data() { return _base; }
+    const char* data() const { return _base; }
+    size_t size() const { return _size; }
+    const std::string& path() const { return _path; }
+
+private:
+    void swap(MappedFile& other) noexcept
+    {
+        std::swap(_path, other._path);
+        std::swap(_base, other._base);
+        std::swap(_size, other._size);
+#if defined(_WIN32)
+        std::swap(_file, other._file);
+        std::swap(_mapping, other._mapping);
+#endif
+    }
+
+    void release() noexcept
+    {
+#if defined(_WIN32)
+        if (_base != nullptr)
+            UnmapViewOfFile(_base);
+        if (_mapping != NULL)
+            CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE)
+            CloseHandle(_file);
+
+        _mapping = NULL;
+        _file = INVALID_HANDLE_VALUE;
+#else
+        if (_base != nullptr)
+            ::munmap(_base, _size);
+#endif
+        _base = nullptr;
+        _size = 0;
+    }
+};
+
+} // namespace wav
+
+#endif
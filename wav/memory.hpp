@@ -0,0 +1,211 @@
+#ifndef _WAV_MEMORY_H
+#define _WAV_MEMORY_H
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+// Memory resources for sample and scratch buffers
+// Waveforms take their buffers from a std::pmr::memory_resource (see BasicWaveform::memory), 64-byte aligned
+// new/delete unless told otherwise. A Pool keeps released buffers for the next allocation of the same size class,
+// so processing many files back to back stops paying for allocations and page faults on every one
+namespace wav {
+namespace memory {
+    // Every buffer starts on a cache line, which is also a full vector for any SIMD width in use
+    constexpr size_t alignment = 64;
+
+    // Buffers this large are aligned to (transparent) huge pages by a Pool
+    constexpr size_t huge_page = size_t(2) << 20;
+
+    // Plain new/delete, aligned to at least `alignment`
+    class AlignedResource final : public std::pmr::memory_resource {
+    private:
+        void* do_allocate(size_t bytes, size_t align) override
+        {
+            return ::operator new(bytes, std::align_val_t(std::max(align, alignment)));
+        }
+
+        void do_deallocate(void* pointer, size_t, size_t align) override
+        {
+            ::operator delete(pointer, std::align_val_t(std::max(align, alignment)));
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return dynamic_cast<const AlignedResource*>(&other) != nullptr;
+        }
+    };
+
+    inline std::pmr::memory_resource* aligned()
+    {
+        static AlignedResource resource;
+        return &resource;
+    }
+
+    // Smallest size class holding `bytes`: four classes per power of two (1, 1.25, 1.5 and 1.75 times 2^k), so
+    // at most a quarter of a buffer goes unused, and none below 256 bytes
+    inline size_t size_class(size_t bytes)
+    {
+        if (bytes <= 256)
+            return 256;
+
+        size_t step = size_t(1) << (std::bit_width(bytes - 1) - 3);
+        return (bytes + step - 1) & ~(step - 1);
+    }
+
+    // Size-class pool: released buffers are kept on a free list per class, up to `capacity` bytes in all, and
+    // handed out again (already paged in) to the next allocation of their class. Buffers of at least `huge_page`
+    // bytes are aligned to it and, on Linux, advised as transparent huge pages, so large sample buffers take
+    // fewer TLB entries
+    // Thread-safe; the pool must outlive every buffer allocated from it
+    class Pool final : public std::pmr::memory_resource {
+    public:
+        struct Usage {
+            size_t cached = 0;
+            uint64_t allocated = 0;
+            uint64_t reused = 0;
+        };
+
+    private:
+        mutable std::mutex _lock;
+        std::unordered_map<size_t, std::vector<void*>> _free;
+
+        size_t _capacity;
+        bool _huge_pages;
+        Usage _usage;
+
+    public:
+        explicit Pool(size_t capacity = size_t(256) << 20, bool huge_pages = true)
+            : _capacity(capacity)
+            , _huge_pages(huge_pages)
+        {
+        }
+
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        ~Pool() override { release(); }
+
+        // Bytes kept for reuse at most; lowering it frees what no longer fits
+        void capacity(size_t bytes)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _capacity = bytes;
+            trim();
+        }
+
+        Usage usage() const
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _usage;
+        }
+
+        // Frees every cached buffer
+        void release()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            size_t capacity = _capacity;
+            _capacity = 0;
+            trim();
+            _capacity = capacity;
+        }
+
+    private:
+        size_t class_alignment(size_t size) const { return _huge_pages && size >= huge_page ? huge_page : alignment; }
+
+        void* do_allocate(size_t bytes, size_t align) override
+        {
+            size_t size = size_class(bytes);
+
+            // Stricter alignments than the class provides are rare, they bypass the pool
+            if (align > class_alignment(size))
+                return ::operator new(bytes, std::align_val_t(align));
+
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                auto found = _free.find(size);
+
+                if (found != _free.end() && found->second.empty() == false) {
+                    void* pointer = found->second.back();
+                    found->second.pop_back();
+
+                    _usage.cached -= size;
+                    _usage.reused++;
+                    return pointer;
+                }
+
+                _usage.allocated++;
+            }
+
+            void* pointer = ::operator new(size, std::align_val_t(class_alignment(size)));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+            if (class_alignment(size) == huge_page)
+                madvise(pointer, size, MADV_HUGEPAGE);
+#endif
+            return pointer;
+        }
+
+        void do_deallocate(void* pointer, size_t bytes, size_t align) override
+        {
+            size_t size = size_class(bytes);
+
+            if (align > class_alignment(size)) {
+                ::operator delete(pointer, std::align_val_t(align));
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                if (_usage.cached + size <= _capacity) {
+                    _free[size].push_back(pointer);
+                    _usage.cached += size;
+                    return;
+                }
+            }
+
+            ::operator delete(pointer, std::align_val_t(class_alignment(size)));
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+        // Frees cached buffers, largest first, until the cache fits the capacity; the lock must be held
+        void trim()
+        {
+            std::vector<size_t> sizes;
+            for (const auto& [size, buffers] : _free)
+                sizes.push_back(size);
+            std::sort(sizes.rbegin(), sizes.rend());
+
+            for (size_t size : sizes) {
+                std::vector<void*>& buffers = _free[size];
+
+                while (_usage.cached > _capacity && buffers.empty() == false) {
+                    ::operator delete(buffers.back(), std::align_val_t(class_alignment(size)));
+                    buffers.pop_back();
+                    _usage.cached -= size;
+                }
+            }
+        }
+    };
+
+    // Pool of the calling thread, for scratch space and for the buffers of waveforms processed on that thread
+    // (e.g. by a batch worker); keeps up to 64 MiB
+    inline Pool& local()
+    {
+        thread_local Pool pool(size_t(64) << 20);
+        return pool;
+    }
+} // namespace memory
+} // namespace wav
+
+#endif
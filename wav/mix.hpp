@@ -0,0 +1,375 @@
+#ifndef _WAV_MIX_H
+#define _WAV_MIX_H
+
+#include "../waveform.hpp"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace wav {
+
+// Sums any number of 16-bit stems into one signal, each with its own gain, pan and position in time
+// The mix is rendered block by block. Every block, each stem overlapping it contributes its frames, read from its
+// file for stems added by name, so memory holds one block per stem and never a whole stem. Within a block, tiles of
+// `tile` frames are spread across the workers; a tile's float sums (16 KB in stereo) stay in cache while every stem
+// is added into them, and are rounded and saturated to 16 bits once at the end, so stems never clip each other
+class Mixer {
+public:
+    static constexpr size_t default_block = size_t(1) << 16;
+    static constexpr size_t tile = 2048;
+
+    // Where and how loud a stem enters the mix
+    struct Placement {
+        float gain = 1;
+
+        // -1 (left) to 1 (right), for stereo mixes. Mono stems are panned at constant power, -3 dB on each side in
+        // the centre; stereo stems are balanced, attenuating the far side only
+        float pan = 0;
+
+        // Frame of the mix the stem starts at; a negative offset cuts off the start of the stem
+        int64_t offset = 0;
+    };
+
+private:
+    struct Track {
+        // In memory; empty for stems streamed from `source`
+        Waveform waveform;
+        std::string source;
+        size_t data_offset = 0;
+
+        size_t frames = 0;
+        int channels = 1;
+        int64_t offset = 0;
+
+        // Stems with the mix's channel count scale each channel, mono ones into stereo spread to both sides, and
+        // anything else goes through a matrix of mix by stem channels
+        enum class Route {
+            Direct,
+            Spread,
+            Matrix
+        } route
+            = Route::Direct;
+        std::vector<float> gains;
+
+        int64_t begin() const { return offset; }
+        int64_t end() const { return offset + (int64_t)frames; }
+    };
+
+    int _sample_rate;
+    int _channels;
+    size_t _block;
+    float _master = 1;
+
+    Parallelism _parallelism;
+    std::vector<Track> _tracks;
+
+public:
+    // `block` frames are rendered at a time
+    // Throws std::invalid_argument for a sample rate or channel count that is not positive
+    explicit Mixer(int sample_rate, int channels = 2, size_t block = default_block)
+        : _sample_rate(sample_rate)
+        , _channels(channels)
+        , _block(std::max<size_t>(block, 1))
+    {
+        if (sample_rate <= 0 || channels < 1)
+            throw std::invalid_argument("A mix needs a positive sample rate and at least one channel.");
+    }
+
+    int sample_rate() const { return _sample_rate; }
+    int channels() const { return _channels; }
+    size_t stems() const { return _tracks.size(); }
+
+    // Frames from the start of the mix to the end of its last stem
+    size_t frames() const
+    {
+        int64_t end = 0;
+        for (const Track& track : _tracks)
+            end = std::max(end, track.end());
+
+        return (size_t)end;
+    }
+
+    // Workers across the tiles of each block, see Waveform::parallel
+    Mixer& parallel(int threads, size_t grain = Parallelism::default_grain)
+    {
+        _parallelism = Parallelism { threads, grain };
+        return *this;
+    }
+
+    // Gain applied to the sum, before it is rounded to 16 bits
+    Mixer& master(float gain)
+    {
+        _master = gain;
+        return *this;
+    }
+
+    // Shares the samples of `stem` (see BasicWaveform copies), which must not change while the mixer uses them
+    // Throws std::invalid_argument for a stem at another sample rate, or one whose channels cannot be routed
+    Mixer& add(const Waveform& stem) { return add(stem, Placement()); }
+    Mixer& add(const Waveform& stem, const Placement& placement)
+    {
+        Track track;
+        track.waveform = stem;
+        if (track.waveform.layout() == Layout::Planar)
+            track.waveform.interleaved();
+
+        track.channels = std::max(stem.channels(), 1);
+        track.frames = track.waveform.samples().size() / track.channels;
+
+        return add(std::move(track), stem.header().sample_rate, placement);
+    }
+
+    // Streams the stem from its file while mixing; only its header is read here
+    // Throws std::runtime_error when the file cannot be opened or does not hold 16-bit PCM, and
+    // std::invalid_argument like add(const Waveform&)
+    Mixer& add(const std::string& source) { return add(source, Placement()); }
+    Mixer& add(const std::string& source, const Placement& placement)
+    {
+        Probe info = probe(source);
+        if (holds<format::S16>(info.header) == false)
+            throw std::runtime_error("Only 16-bit PCM files can be mixed.");
+
+        std::error_code error;
+        size_t size = (size_t)std::filesystem::file_size(source, error);
+        size_t available = size > info.data_offset ? size - info.data_offset : 0;
+
+        Track track;
+        track.source = source;
+        track.data_offset = info.data_offset;
+        track.channels = std::max<int>(info.header.num_channels, 1);
+        track.frames = std::min(info.data_bytes(), available) / sizeof(short) / track.channels;
+
+        return add(std::move(track), info.header.sample_rate, placement);
+    }
+
+    // Hands the mix to `sink` block by block, which returns false to abort
+    template <typename Sink>
+    int render(Sink sink) const
+    {
+        std::vector<std::ifstream> files(_tracks.size());
+        for (size_t i = 0; i < _tracks.size(); i++) {
+            if (_tracks[i].source.empty())
+                continue;
+
+            files[i].open(_tracks[i].source, std::ios::binary);
+            if (files[i].is_open() == false) {
+                std::cerr << "Error: Could not open " << _tracks[i].source << "." << std::endl;
+                return FAILURE;
+            }
+        }
+
+        // Recycled by the thread's pool across blocks and mixes
+        std::pmr::vector<short> output(_block * _channels, &memory::local());
+        std::vector<std::pmr::vector<short>> buffers;
+        for (const Track& track : _tracks)
+            buffers.emplace_back(track.source.empty() ? 0 : _block * track.channels, &memory::local());
+
+        // Per stem overlapping the block, its first frame within the block, the end of its frames and where they are
+        struct Segment {
+            const Track* track;
+            size_t begin, end;
+            const short* samples;
+        };
+        std::vector<Segment> segments;
+
+        size_t total = frames();
+        for (size_t start = 0; start < total; start += _block) {
+            size_t length = std::min(_block, total - start);
+            segments.clear();
+
+            for (size_t i = 0; i < _tracks.size(); i++) {
+                const Track& track = _tracks[i];
+
+                int64_t first = std::max<int64_t>(track.begin(), (int64_t)start);
+                int64_t last = std::min<int64_t>(track.end(), (int64_t)(start + length));
+                if (first >= last)
+                    continue;
+
+                size_t count = (size_t)(last - first);
+                size_t position = (size_t)(first - track.offset);
+                const short* samples;
+
+                if (track.source.empty()) {
+                    samples = track.waveform.samples().data() + position * track.channels;
+                } else {
+                    std::ifstream& file = files[i];
+                    file.seekg((std::streamoff)(track.data_offset + position * track.channels * sizeof(short)));
+                    file.read((char*)buffers[i].data(), (std::streamsize)(count * track.channels * sizeof(short)));
+
+                    if ((size_t)file.gcount() != count * track.channels * sizeof(short)) {
+                        std::cerr << "Error: Unexpected end of " << track.source << "." << std::endl;
+                        return FAILURE;
+                    }
+
+                    samples = buffers[i].data();
+                }
+
+                segments.push_back({ &track, (size_t)first - start, (size_t)last - start, samples });
+            }
+
+            Parallelism tasks = _parallelism;
+            tasks.grain = std::max<size_t>(_parallelism.grain / tile / _channels, 1);
+
+            parallel_for((length + tile - 1) / tile, tasks, [&](size_t, size_t begin, size_t end) {
+                std::pmr::vector<float> sums(tile * _channels, &memory::local());
+
+                for (size_t index = begin; index < end; index++) {
+                    size_t first = index * tile;
+                    size_t last = std::min(first + tile, length);
+
+                    std::fill(sums.begin(), sums.end(), 0.0f);
+                    for (const Segment& segment : segments) {
+                        size_t from = std::max(first, segment.begin);
+                        size_t to = std::min(last, segment.end);
+
+                        if (from < to) {
+                            const short* samples = segment.samples + (from - segment.begin) * segment.track->channels;
+                            accumulate(*segment.track, sums.data() + (from - first) * _channels, samples, to - from);
+                        }
+                    }
+
+                    if (_master != 1.0f)
+                        for (float& sum : sums)
+                            sum *= _master;
+
+                    simd::quantize(output.data() + first * _channels, sums.data(), (last - first) * _channels);
+                }
+            });
+
+            if (sink(std::span<const short>(output.data(), length * _channels)) == false)
+                return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    // Mix in memory
+    // Throws std::runtime_error when a streamed stem can no longer be opened or ends early, rather than returning a
+    // mix that is partly silent
+    Waveform mix() const
+    {
+        Waveform result;
+        result.header() = make_header<format::S16>(_sample_rate, _channels);
+
+        auto& samples = result.data();
+        samples.resize(frames() * _channels);
+
+        size_t written = 0;
+        int status = render([&](std::span<const short> block) {
+            std::copy(block.begin(), block.end(), samples.begin() + (ptrdiff_t)written);
+            written += block.size();
+            return true;
+        });
+
+        if (status)
+            throw std::runtime_error("A stem could not be read.");
+
+        result.header().subchunk2_size = (int)(samples.size() * sizeof(short));
+        return result;
+    }
+
+    // Writes the mix as it is rendered, in bounded memory
+    int save(const std::string& destination = "mix.wav", bool verbose = true) const
+    {
+        for (const Track& track : _tracks) {
+            std::error_code error;
+            if (track.source.empty() == false && std::filesystem::equivalent(track.source, destination, error)) {
+                std::cerr << "Error: Cannot mix " << track.source << " onto itself." << std::endl;
+                return FAILURE;
+            }
+        }
+
+        std::ofstream file(destination, std::ios::binary);
+        if (file.is_open() == false) {
+            std::cerr << "Error: Could not open " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        auto header = encode_header(make_header<format::S16>(_sample_rate, _channels), frames() * _channels * sizeof(short));
+        file.write(header.data(), header.size());
+
+        int status = render([&file](std::span<const short> block) {
+            file.write((const char*)block.data(), block.size_bytes());
+            return file.good();
+        });
+
+        if (status || file.good() == false) {
+            std::cerr << "Error: Could not save information data to " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        file.close();
+        if (verbose)
+            std::cout << "Sucessfully saved to " << destination << "." << std::endl;
+
+        return SUCCESS;
+    }
+
+private:
+    Mixer& add(Track track, int sample_rate, const Placement& placement)
+    {
+        if (sample_rate != _sample_rate)
+            throw std::invalid_argument("Stems must have the sample rate of the mix, resample them first.");
+
+        int in = track.channels;
+        float gain = placement.gain;
+        float pan = std::clamp(placement.pan, -1.0f, 1.0f);
+        track.offset = placement.offset;
+
+        if (in == _channels) {
+            track.route = Track::Route::Direct;
+            track.gains.assign(in, gain);
+
+            if (in == 2) {
+                track.gains[0] *= std::min(1.0f, 1 - pan);
+                track.gains[1] *= std::min(1.0f, 1 + pan);
+            }
+        } else if (in == 1 && _channels == 2) {
+            double angle = (pan + 1) * std::numbers::pi / 4;
+            track.route = Track::Route::Spread;
+            track.gains = { gain * (float)std::cos(angle), gain * (float)std::sin(angle) };
+        } else if (in == 1 || _channels == 1) {
+            // Mono copied to every channel, or every channel averaged into mono
+            track.route = Track::Route::Matrix;
+            track.gains.assign((size_t)_channels * in, _channels == 1 ? gain / in : gain);
+        } else {
+            throw std::invalid_argument("Stems must be mono or have the channel count of the mix.");
+        }
+
+        _tracks.push_back(std::move(track));
+        return *this;
+    }
+
+    // Adds `frames` frames of a stem into interleaved sums
+    void accumulate(const Track& track, float* sums, const short* samples, size_t frames) const
+    {
+        switch (track.route) {
+        case Track::Route::Direct:
+            simd::mix(sums, samples, frames * _channels, track.gains.data(), (size_t)_channels);
+            break;
+        case Track::Route::Spread:
+            simd::spread(sums, samples, frames, track.gains[0], track.gains[1]);
+            break;
+        case Track::Route::Matrix:
+            for (size_t frame = 0; frame < frames; frame++) {
+                const short* in = samples + frame * track.channels;
+                float* out = sums + frame * _channels;
+
+                for (int o = 0; o < _channels; o++)
+                    for (int c = 0; c < track.channels; c++)
+                        out[o] += (float)in[c] * track.gains[(size_t)o * track.channels + c];
+            }
+            break;
+        }
+    }
+};
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,347 @@
+#ifndef _WAV_OVERVIEW_H
+#define _WAV_OVERVIEW_H
+
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "signal_stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace wav {
+
+// Min/max/RMS pyramid of a 16-bit signal, for drawing zoomable overviews without touching the samples
+// Level 0 summarizes every `base` frames of each channel, every level above combines `factor` buckets of the one
+// below, up to a level of a single bucket. Buckets take 8 bytes per channel, so for the defaults the whole pyramid
+// is about 2% of the size of the samples; it is saved to and loaded from a sidecar file
+// query() answers from the level whose buckets are just below a pixel's width, so its cost follows the number of
+// pixels, whatever the length of the range
+class Overview {
+public:
+    // Summary of a bucket or a pixel of one channel
+    struct Column {
+        short min = 0;
+        short max = 0;
+        float rms = 0;
+    };
+
+    static constexpr uint32_t default_base = 256;
+    static constexpr uint32_t default_factor = 4;
+
+private:
+    int _channels = 1;
+    int _sample_rate = 0;
+    uint64_t _frames = 0;
+    uint32_t _base = default_base;
+    uint32_t _factor = default_factor;
+
+    // Per level, the buckets in order, each holding one column per channel
+    std::vector<std::vector<Column>> _levels;
+
+public:
+    Overview() = default;
+
+    // Sample i of channel c is channels[c][i * stride], `frames` of them
+    // Level 0 is split across the configured workers, the levels above are derived from it
+    // Throws std::invalid_argument for a base below 1 or a factor below 2
+    Overview(std::span<const short* const> channels, size_t frames, size_t stride, int sample_rate,
+        const Parallelism& parallelism = {}, uint32_t base = default_base, uint32_t factor = default_factor)
+        : _channels(std::max<int>((int)channels.size(), 1))
+        , _sample_rate(sample_rate)
+        , _frames(frames)
+        , _base(base)
+        , _factor(factor)
+    {
+        if (base < 1 || factor < 2)
+            throw std::invalid_argument("Overview needs a base of at least 1 and a factor of at least 2.");
+
+        size_t buckets = (size_t)((frames + base - 1) / base);
+        std::vector<Column>& first = _levels.emplace_back(buckets * _channels);
+
+        Parallelism tasks = parallelism;
+        tasks.grain = std::max<size_t>(parallelism.grain / base / _channels, 1);
+
+        parallel_for(buckets, tasks, [&](size_t, size_t begin, size_t end) {
+            // Strided channels are gathered bucket by bucket, for the vectorized summary
+            std::pmr::vector<short> gathered(stride != 1 ? base : 0, &memory::local());
+
+            for (size_t bucket = begin; bucket < end; bucket++) {
+                size_t offset = bucket * base;
+                size_t count = std::min<size_t>(base, frames - offset);
+
+                for (int channel = 0; channel < (int)channels.size(); channel++) {
+                    const short* samples = channels[channel] + offset * stride;
+                    if (stride != 1) {
+                        for (size_t i = 0; i < count; i++)
+                            gathered[i] = samples[i * stride];
+                        samples = gathered.data();
+                    }
+
+                    SignalStats stats;
+                    simd::summarize(samples, count, stats);
+                    first[bucket * _channels + channel] = { stats.min, stats.max, (float)stats.rms() };
+                }
+            }
+        });
+
+        while (_levels.back().size() > (size_t)_channels)
+            _levels.push_back(coarsen(_levels.size() - 1));
+    }
+
+    // Reads a sidecar written by save(); throws std::runtime_error when the file cannot be opened or is not a
+    // complete overview
+    explicit Overview(const std::string& source)
+    {
+        std::ifstream file(source, std::ios::binary);
+        if (file.is_open() == false)
+            throw std::runtime_error("Specified file could not be opened.");
+
+        char bytes[header_bytes];
+        if (file.read(bytes, sizeof(bytes)).good() == false || memcmp(bytes, "WOVR", 4) != 0)
+            throw std::runtime_error("Not an overview file.");
+
+        const char* in = bytes + 4;
+        auto get = [&in](void* field, size_t size) {
+            memcpy(field, in, size);
+            in += size;
+        };
+
+        uint16_t version, channels;
+        uint32_t levels;
+        get(&version, 2);
+        get(&channels, 2);
+        get(&_sample_rate, 4);
+        get(&_base, 4);
+        get(&_factor, 4);
+        get(&levels, 4);
+        get(&_frames, 8);
+
+        if (version != 1 || channels == 0 || _base < 1 || _factor < 2)
+            throw std::runtime_error("Unsupported overview version.");
+
+        _channels = channels;
+
+        // Sizes below all follow from the header, so it has to describe the pyramid save() writes for its frames,
+        // and the file has to hold all of it, before anything is allocated
+        uint64_t expected = 0, columns = 0;
+        if (layout(expected, columns) == false || expected != levels)
+            throw std::runtime_error("Overview file is corrupt.");
+
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(source, error);
+        if (error || columns > (size - header_bytes) / sizeof(Column))
+            throw std::runtime_error("Overview file is truncated.");
+
+        for (uint32_t level = 0; level < levels; level++) {
+            auto& columns = _levels.emplace_back(buckets(level) * _channels);
+            if (file.read((char*)columns.data(), (std::streamsize)(columns.size() * sizeof(Column))).good() == false)
+                throw std::runtime_error("Overview file is truncated.");
+        }
+    }
+
+    int channels() const { return _channels; }
+    int sample_rate() const { return _sample_rate; }
+    uint64_t frames() const { return _frames; }
+    double duration() const { return _sample_rate > 0 ? (double)_frames / _sample_rate : 0.0; }
+
+    size_t levels() const { return _levels.size(); }
+
+    // Frames per bucket of a level
+    uint64_t bucket_frames(size_t level) const
+    {
+        uint64_t frames = _base;
+        for (size_t i = 0; i < level; i++)
+            frames *= _factor;
+
+        return frames;
+    }
+
+    // Buckets of a level, one column per channel each
+    std::span<const Column> level(size_t index) const { return _levels.at(index); }
+
+    // Columns for `width` pixels spanning frames [first, first + count), pixel after pixel and channel after
+    // channel. Each pixel combines the buckets of the coarsest level that is still finer than it; zoomed in
+    // further than level 0, pixels come from the interleaved `samples` when given, and repeat the level 0 bucket
+    // they fall into otherwise
+    std::vector<Column> query(uint64_t first, uint64_t count, size_t width, std::span<const short> samples = {}) const
+    {
+        std::vector<Column> columns(width * _channels);
+
+        first = std::min(first, _frames);
+        count = std::min(count, _frames - first);
+        if (width == 0 || count == 0 || _levels.empty())
+            return columns;
+
+        double per_pixel = (double)count / (double)width;
+        bool exact = per_pixel < _base && samples.size() >= (size_t)(first + count) * _channels;
+
+        size_t level = 0;
+        while (level + 1 < _levels.size() && (double)bucket_frames(level + 1) <= per_pixel)
+            level++;
+
+        for (size_t pixel = 0; pixel < width; pixel++) {
+            uint64_t begin = first + (uint64_t)((double)pixel * per_pixel);
+            uint64_t end = std::max(first + (uint64_t)((double)(pixel + 1) * per_pixel), begin + 1);
+            Column* out = &columns[pixel * _channels];
+
+            if (exact)
+                summarize(samples, begin, std::min(end, first + count), out);
+            else
+                combine(level, begin, std::min(end, _frames), out);
+        }
+
+        return columns;
+    }
+
+    // Same as query(), for the time range [start, end) in seconds
+    std::vector<Column> seconds(double start, double end, size_t width, std::span<const short> samples = {}) const
+    {
+        uint64_t first = (uint64_t)std::max(0.0, std::floor(start * _sample_rate));
+        uint64_t last = (uint64_t)std::max(0.0, std::ceil(end * _sample_rate));
+
+        return query(first, last > first ? last - first : 0, width, samples);
+    }
+
+    // Sidecar file: a 32-byte header, then the columns of every level from 0 up, each a 16-bit min and max and a
+    // 32-bit float RMS. Header fields, native (little-endian) byte order: "WOVR", version and channels (16 bits),
+    // sample rate, base, factor and levels (32 bits), frames (64 bits)
+    // Returns false when the file could not be written
+    bool save(const std::string& destination) const
+    {
+        std::ofstream file(destination, std::ios::binary);
+        if (file.is_open() == false)
+            return false;
+
+        char bytes[header_bytes];
+        char* out = bytes;
+
+        auto put = [&out](const void* field, size_t size) {
+            memcpy(out, field, size);
+            out += size;
+        };
+
+        uint16_t version = 1, channels = (uint16_t)_channels;
+        uint32_t levels = (uint32_t)_levels.size();
+
+        put("WOVR", 4);
+        put(&version, 2);
+        put(&channels, 2);
+        put(&_sample_rate, 4);
+        put(&_base, 4);
+        put(&_factor, 4);
+        put(&levels, 4);
+        put(&_frames, 8);
+
+        file.write(bytes, sizeof(bytes));
+        for (const auto& columns : _levels)
+            file.write((const char*)columns.data(), (std::streamsize)(columns.size() * sizeof(Column)));
+
+        return file.good();
+    }
+
+private:
+    static constexpr size_t header_bytes = 32;
+    static_assert(sizeof(Column) == 8, "Columns are stored as they sit in memory");
+
+    size_t buckets(size_t level) const
+    {
+        uint64_t frames = bucket_frames(level);
+        return (size_t)std::max<uint64_t>(_frames / frames + (_frames % frames != 0), level == 0 ? 0 : 1);
+    }
+
+    // Levels of the pyramid for the frames, base and factor, up to the one of a single bucket, and the columns in
+    // all of them; false when they do not fit 64 bits
+    bool layout(uint64_t& levels, uint64_t& columns) const
+    {
+        uint64_t frames = _base;
+        levels = columns = 0;
+
+        for (;;) {
+            uint64_t count = std::max<uint64_t>(_frames / frames + (_frames % frames != 0), levels == 0 ? 0 : 1);
+            if (count > (UINT64_MAX - columns) / (uint64_t)_channels)
+                return false;
+
+            columns += count * (uint64_t)_channels;
+            levels++;
+
+            if (count <= 1)
+                return true;
+            if (frames > UINT64_MAX / _factor)
+                return false;
+
+            frames *= _factor;
+        }
+    }
+
+    // Level above `level`, each bucket combining `factor` of it
+    std::vector<Column> coarsen(size_t level) const
+    {
+        std::vector<Column> columns(buckets(level + 1) * _channels);
+        uint64_t frames = bucket_frames(level + 1);
+
+        for (size_t bucket = 0; bucket < columns.size() / _channels; bucket++)
+            combine(level, bucket * frames, std::min(_frames, (bucket + 1) * frames), &columns[bucket * _channels]);
+
+        return columns;
+    }
+
+    // Combines the buckets of a level overlapping frames [begin, end) into one column per channel; the mean square
+    // of each bucket counts by the frames in it
+    void combine(size_t level, uint64_t begin, uint64_t end, Column* out) const
+    {
+        const std::vector<Column>& columns = _levels[level];
+        uint64_t frames = bucket_frames(level);
+        size_t available = columns.size() / _channels;
+
+        size_t first = (size_t)std::min<uint64_t>(begin / frames, available - 1);
+        size_t last = (size_t)std::clamp<uint64_t>((end + frames - 1) / frames, first + 1, available);
+
+        for (int channel = 0; channel < _channels; channel++) {
+            short low = columns[first * _channels + channel].min;
+            short high = columns[first * _channels + channel].max;
+            double power = 0, weight = 0;
+
+            for (size_t bucket = first; bucket < last; bucket++) {
+                const Column& column = columns[bucket * _channels + channel];
+                double count = (double)std::min<uint64_t>(frames, _frames - bucket * frames);
+
+                low = std::min(low, column.min);
+                high = std::max(high, column.max);
+                power += (double)column.rms * column.rms * count;
+                weight += count;
+            }
+
+            out[channel] = { low, high, (float)std::sqrt(weight > 0 ? power / weight : 0.0) };
+        }
+    }
+
+    // Columns of interleaved frames [begin, end) straight from the samples
+    void summarize(std::span<const short> samples, uint64_t begin, uint64_t end, Column* out) const
+    {
+        for (int channel = 0; channel < _channels; channel++) {
+            SignalStats stats;
+            for (uint64_t frame = begin; frame < end; frame++) {
+                short sample = samples[(size_t)frame * _channels + channel];
+                stats.min = std::min(stats.min, sample);
+                stats.max = std::max(stats.max, sample);
+                stats.sum_squares += (uint64_t)((int)sample * sample);
+                stats.count++;
+            }
+
+            out[channel] = { stats.min, stats.max, (float)stats.rms() };
+        }
+    }
+};
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _WAV_PARALLEL_H
+#define _WAV_PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wav {
+
+// Opt-in multi-core execution settings
+// Work is split into tasks of at least `grain` samples; without OpenMP (-fopenmp, /openmp) everything runs serially
+struct Parallelism {
+    static constexpr size_t default_grain = size_t(1) << 16;
+
+    // Worker threads: 1 keeps everything on the calling thread, 0 uses every available core
+    int threads = 1;
+
+    // Minimum number of samples handed to a single task
+    size_t grain = default_grain;
+
+    int workers() const
+    {
+#ifdef _OPENMP
+        return threads > 0 ? threads : omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    // Number of tasks `count` samples are split into
+    size_t tasks(size_t count) const
+    {
+        size_t size = std::max<size_t>(grain, 1);
+        return workers() > 1 ? (count + size - 1) / size : (count > 0 ? 1 : 0);
+    }
+};
+
+// Filters whose output depends on previously seen samples declare `static constexpr bool sequential = true;`
+// and are never split across threads
+template <typename Filter>
+concept SequentialFilter = requires { requires Filter::sequential; };
+
+// Calls body(task, begin, end) for consecutive ranges covering [0, count), spread across the configured workers
+template <typename Body>
+void parallel_for(size_t count, const Parallelism& parallelism, Body body)
+{
+    size_t tasks = parallelism.tasks(count);
+
+    if (tasks <= 1) {
+        if (count > 0)
+            body(size_t(0), size_t(0), count);
+        return;
+    }
+
+    size_t size = (count + tasks - 1) / tasks;
+
+    // OpenMP 2.0 (MSVC) requires a signed loop index
+    long long total = (long long)tasks;
+
+#if defined(_OPENMP) && _OPENMP >= 201511
+    // Called from within a parallel region (e.g. by a batch worker), the tasks go to the team that is already
+    // running instead of a nested one, so idle workers pick them up; the loop returns once all of them are done
+    if (omp_in_parallel()) {
+#pragma omp taskloop grainsize(1) shared(body)
+        for (long long task = 0; task < total; task++) {
+            size_t begin = (size_t)task * size;
+            size_t end = std::min(count, begin + size);
+
+            if (begin < end)
+                body((size_t)task, begin, end);
+        }
+        return;
+    }
+#endif
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(parallelism.workers()) schedule(dynamic, 1)
+#endif
+    for (long long task = 0; task < total; task++) {
+        size_t begin = (size_t)task * size;
+        size_t end = std::min(count, begin + size);
+
+        if (begin < end)
+            body((size_t)task, begin, end);
+    }
+}
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef _WAV_PIPE_H
+#define _WAV_PIPE_H
+
+#include "../waveform.hpp"
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace wav {
+
+// Fixed-size latency histogram: 8 log-spaced buckets per power of two of nanoseconds (~9% resolution)
+// Recording never allocates, so it can sit on a real-time path
+class LatencyHistogram {
+private:
+    static constexpr int sub_buckets = 8;
+    std::array<uint64_t, 64 * sub_buckets> _counts {};
+    uint64_t _total = 0;
+    uint64_t _max = 0;
+
+public:
+    void record(uint64_t nanoseconds)
+    {
+        _counts[bucket(nanoseconds)]++;
+        _total++;
+        _max = std::max(_max, nanoseconds);
+    }
+
+    uint64_t count() const { return _total; }
+    uint64_t max() const { return _max; }
+
+    // Upper bound of the bucket holding the given percentile [0, 100], in nanoseconds
+    uint64_t percentile(double p) const
+    {
+        if (_total == 0)
+            return 0;
+
+        uint64_t rank = (uint64_t)std::ceil(p / 100.0 * (double)_total);
+        rank = std::clamp<uint64_t>(rank, 1, _total);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _counts.size(); i++) {
+            seen += _counts[i];
+            if (seen >= rank)
+                return std::min(upper_bound(i), _max);
+        }
+
+        return _max;
+    }
+
+private:
+    static size_t bucket(uint64_t value)
+    {
+        if (value < sub_buckets)
+            return (size_t)value;
+
+        // Position of the leading bit selects the octave, the next three bits the sub-bucket
+        int octave = std::bit_width(value) - 1;
+        uint64_t fraction = (value >> (octave - 3)) & (sub_buckets - 1);
+
+        return (size_t)(octave - 2) * sub_buckets + (size_t)fraction;
+    }
+
+    static uint64_t upper_bound(size_t index)
+    {
+        if (index < sub_buckets)
+            return index;
+
+        int octave = (int)(index / sub_buckets) + 2;
+        uint64_t fraction = index % sub_buckets;
+
+        if (octave >= 63)
+            return UINT64_MAX;
+
+        return ((sub_buckets + fraction + 1) << (octave - 3)) - 1;
+    }
+};
+
+// Low-latency block pipeline between two byte streams (typically stdin and stdout)
+// Input is either raw 16-bit little-endian PCM or a WAV stream, whose header is parsed sequentially (no seeking)
+// and passed on. Every block of `frames` frames runs through the filter and is flushed right away; all buffers
+// are allocated up front, so the steady-state loop does not allocate
+template <typename Functor>
+class Pipe {
+private:
+    Functor _action;
+    size_t _frames;
+    LatencyHistogram _latency;
+
+public:
+    Pipe(Functor action, size_t frames = 256)
+        : _action(action)
+        , _frames(std::max<size_t>(frames, 1))
+    {
+    }
+
+    // Processing time per block, from the block being read to it being filtered
+    const LatencyHistogram& latency() const { return _latency; }
+
+    int run(FILE* in, FILE* out, bool wav_input = true)
+    {
+#if defined(_WIN32)
+        _setmode(_fileno(in), _O_BINARY);
+        _setmode(_fileno(out), _O_BINARY);
+#endif
+        size_t channels = 1;
+
+        // Samples to filter; without a usable declared data size, everything up to the end of the stream
+        uint64_t remaining = UINT64_MAX;
+        bool declared = false;
+
+        if (wav_input) {
+            WAVHeader header {};
+            if (read_stream_header(in, header)) {
+                std::cerr << "Error: Input is not a WAVE stream." << std::endl;
+                return FAILURE;
+            }
+
+            if (header.bits_per_sample != 16) {
+                std::cerr << "Error: Only 16-bit PCM streams are supported." << std::endl;
+                return FAILURE;
+            }
+
+            channels = std::max<short>(header.num_channels, 1);
+
+            // Streamed WAVs commonly declare 0 or 0xFFFFFFFF; any other size ends the samples there, whole frames only
+            uint32_t size = (uint32_t)header.subchunk2_size;
+            if (size != 0 && size != UINT32_MAX) {
+                remaining = size / sizeof(short) / channels * channels;
+                declared = true;
+            }
+
+            // The data size is passed on as it is, streamed WAVs commonly declare 0 or 0xFFFFFFFF
+            auto bytes = encode_header(header, (uint32_t)header.subchunk2_size);
+            fwrite(bytes.data(), 1, bytes.size(), out);
+            fflush(out);
+        }
+
+        std::pmr::vector<short> buffer(_frames * channels, &memory::local());
+
+        // A short read only happens at the end of the stream; frames are never split between blocks
+        while (remaining > 0) {
+            size_t count = fread(buffer.data(), sizeof(short), (size_t)std::min<uint64_t>(buffer.size(), remaining), in);
+            count -= count % channels;
+            if (count == 0)
+                break;
+
+            remaining -= count;
+
+            auto start = std::chrono::steady_clock::now();
+            apply_filter(_action, std::span<short>(buffer.data(), count));
+            auto end = std::chrono::steady_clock::now();
+
+            _latency.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+            if (fwrite(buffer.data(), sizeof(short), count, out) != count || fflush(out) != 0)
+                return FAILURE;
+        }
+
+        // Whatever follows the samples (a partial frame, the pad byte, trailing chunks) is passed on untouched
+        if (declared) {
+            char* bytes = (char*)buffer.data();
+            for (size_t count; (count = fread(bytes, 1, buffer.size() * sizeof(short), in)) > 0;)
+                if (fwrite(bytes, 1, count, out) != count)
+                    return FAILURE;
+
+            if (fflush(out) != 0)
+                return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+private:
+    // Walks the RIFF chunks up to 'data', reading (never seeking) past anything else
+    static int read_stream_header(FILE* in, WAVHeader& header)
+    {
+        char riff[12];
+        if (fread(riff, 1, 12, in) != 12 || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0)
+            return FAILURE;
+
+        memcpy(header.chunk_id.data(), riff, 4);
+        memcpy(&header.chunk_size, riff + 4, 4);
+        memcpy(header.format.data(), riff + 8, 4);
+
+        bool has_format = false;
+        for (;;) {
+            char id[4];
+            uint32_t size;
+            if (fread(id, 1, 4, in) != 4 || fread(&size, 4, 1, in) != 1)
+                return FAILURE;
+
+            if (memcmp(id, "data", 4) == 0) {
+                memcpy(header.subchunk2_id.data(), id, 4);
+                header.subchunk2_size = (int)size;
+
+                return has_format ? SUCCESS : FAILURE;
+            }
+
+            // Chunks are padded to an even size
+            uint64_t remaining = (uint64_t)size + (size & 1);
+
+            if (memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+                char format[16];
+                if (fread(format, 1, 16, in) != 16)
+                    return FAILURE;
+
+                memcpy(header.subchunk1_id.data(), id, 4);
+                header.subchunk1_size = 16;
+                memcpy(&header.audio_format, format, 2);
+                memcpy(&header.num_channels, format + 2, 2);
+                memcpy(&header.sample_rate, format + 4, 4);
+                memcpy(&header.byte_rate, format + 8, 4);
+                memcpy(&header.block_align, format + 12, 2);
+                memcpy(&header.bits_per_sample, format + 14, 2);
+
+                has_format = true;
+                remaining -= 16;
+            }
+
+            char skip[256];
+            while (remaining > 0) {
+                size_t length = (size_t)std::min<uint64_t>(remaining, sizeof(skip));
+                if (fread(skip, 1, length, in) != length)
+                    return FAILURE;
+
+                remaining -= length;
+            }
+        }
+    }
+};
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef _WAV_RESAMPLE_H
+#define _WAV_RESAMPLE_H
+
+#include "convolution.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <numbers>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace wav {
+
+// Sample-rate conversion by a rational factor L / M (160 / 147 from 44.1 to 48 kHz), as a polyphase filter bank
+// Output frame n sits at input position n * M / L. It is the dot product of the input around that position with
+// one of L phases of a windowed-sinc lowpass, which cuts off below the lower of the two Nyquist frequencies, so
+// nothing above it aliases. Flat passband up to 95% of that frequency, at least 80 dB of stopband attenuation
+// Phase tables are built once per rate pair and cached. Rate pairs needing more than max_phases phases
+// (e.g. 44100 to 44101) interpolate linearly between max_phases + 1 tabulated ones
+// A Resampler is immutable after construction and can be shared between files and threads
+class Resampler {
+private:
+    int _from, _to;
+    uint64_t _up, _down; // L and M
+
+    size_t _phases; // tabulated phases: L, or max_phases when interpolating
+    bool _exact;
+
+    size_t _half; // K: input frames on either side of an output that contribute to it
+    size_t _width; // taps per phase, 2K rounded up to a multiple of 16
+
+    std::vector<float> _table; // _phases (+ 1 when interpolating) rows of _width taps
+
+public:
+    static constexpr size_t max_phases = 1024;
+
+    Resampler(int from, int to)
+        : _from(from)
+        , _to(to)
+    {
+        if (from <= 0 || to <= 0)
+            throw std::invalid_argument("Sample rates must be positive.");
+
+        uint64_t divisor = std::gcd((uint64_t)from, (uint64_t)to);
+        _up = (uint64_t)to / divisor;
+        _down = (uint64_t)from / divisor;
+
+        _exact = _up <= max_phases;
+        _phases = _exact ? (size_t)_up : max_phases;
+
+        // Kaiser window for 90 dB, its transition band (5% of the narrower bandwidth on either side of the cut-off)
+        // sets the length
+        constexpr double attenuation = 90;
+        double beta = 0.1102 * (attenuation - 8.7);
+        double band = 0.5 * std::min(1.0, (double)_up / (double)_down); // lower Nyquist, in cycles per input sample
+        double transition = 0.1 * band;
+        double cutoff = band - transition / 2;
+
+        size_t length = (size_t)std::ceil((attenuation - 7.95) / (14.36 * transition));
+        _half = std::max<size_t>((length + 1) / 2, 1);
+        _width = (2 * _half + 15) / 16 * 16;
+
+        size_t rows = _exact ? _phases : _phases + 1;
+        _table.assign(rows * _width, 0.0f);
+
+        for (size_t row = 0; row < rows; row++) {
+            // Tap j weighs input frame base - K + 1 + j, at distance j - K + 1 - fraction from the output
+            double fraction = (double)row / (double)_phases;
+            float* taps = &_table[row * _width];
+
+            double sum = 0;
+            std::vector<double> weights(2 * _half);
+            for (size_t j = 0; j < 2 * _half; j++) {
+                double u = (double)j - (double)_half + 1 - fraction;
+                double x = 2 * cutoff * u;
+                double sinc = x == 0 ? 1 : std::sin(std::numbers::pi_v<double> * x) / (std::numbers::pi_v<double> * x);
+                double r = u / (double)_half;
+                double window = std::abs(r) < 1 ? bessel_i0(beta * std::sqrt(1 - r * r)) / bessel_i0(beta) : 0;
+
+                weights[j] = 2 * cutoff * sinc * window;
+                sum += weights[j];
+            }
+
+            // Every phase passes DC at unity gain, so a constant signal comes out constant
+            for (size_t j = 0; j < 2 * _half; j++)
+                taps[j] = (float)(weights[j] / sum);
+        }
+    }
+
+    // Cached per rate pair, so the tables are built once however many files and streams use them
+    static std::shared_ptr<const Resampler> get(int from, int to)
+    {
+        static std::mutex lock;
+        static std::map<std::pair<int, int>, std::shared_ptr<const Resampler>> resamplers;
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto& resampler = resamplers[{ from, to }];
+        if (resampler == nullptr)
+            resampler = std::make_shared<const Resampler>(from, to);
+
+        return resampler;
+    }
+
+    int from() const { return _from; }
+    int to() const { return _to; }
+
+    // Output frame n reads the input frames [n * M / L - history(), n * M / L + lookahead())
+    size_t history() const { return _half - 1; }
+    size_t lookahead() const { return _width - history(); }
+
+    // Output frames for `input` input frames
+    uint64_t frames(uint64_t input) const { return (input * _up + _down - 1) / _down; }
+
+    // Input frame at or just before output frame n
+    uint64_t position(uint64_t n) const { return n * _down / _up; }
+
+    // Output frames [first, first + count) into output[k * stride]; input[i] is input frame origin + i, and must be
+    // readable (zero outside the signal) over the frames those outputs read
+    void render(const float* input, int64_t origin, uint64_t first, size_t count, short* output, size_t stride = 1) const
+    {
+        // Position and phase advance by M / L per output, without a division each
+        uint64_t base = first * _down / _up;
+        uint64_t phase = first * _down % _up;
+        uint64_t step = _down / _up, remainder = _down % _up;
+
+        for (size_t k = 0; k < count; k++) {
+            output[k * stride] = saturate(at(input + ((int64_t)base - (int64_t)history() - origin), phase));
+
+            base += step;
+            phase += remainder;
+            if (phase >= _up) {
+                phase -= _up;
+                base++;
+            }
+        }
+    }
+
+    // Resamples one channel of `frames` frames, read at input[i * stride], into output[n * stride] for
+    // n < frames(frames); outputs are split across the configured workers
+    void process(const short* input, size_t frames, size_t stride, short* output,
+        const Parallelism& parallelism = {}) const
+    {
+        // The channel as floats, with silence on either side for the first and last outputs
+        std::pmr::vector<float> padded(history() + frames + lookahead(), 0.0f, &memory::local());
+        for (size_t i = 0; i < frames; i++)
+            padded[history() + i] = (float)input[i * stride];
+
+        int64_t origin = -(int64_t)history();
+        parallel_for((size_t)this->frames(frames), parallelism, [&](size_t, size_t begin, size_t end) {
+            render(padded.data(), origin, begin, end - begin, output + begin * stride, stride);
+        });
+    }
+
+private:
+    // Output at `phase`, from the frames starting at `window`
+    float at(const float* window, uint64_t phase) const
+    {
+        if (_exact)
+            return dot(window, &_table[phase * _width]);
+
+        double row = (double)phase * (double)_phases / (double)_up;
+        size_t index = (size_t)row;
+        float weight = (float)(row - (double)index);
+
+        float a = dot(window, &_table[index * _width]);
+        float b = dot(window, &_table[(index + 1) * _width]);
+        return a + weight * (b - a);
+    }
+
+    // Sum of _width products, in sixteen partial sums (independent chains of additions) that the AVX2, SSE2 and
+    // scalar paths add up the same way, so all of them give the same result
+    float dot(const float* x, const float* taps) const
+    {
+#if WAV_SIMD_X86
+        if (simd::level() == simd::Level::AVX2)
+            return dot_avx2(x, taps, _width);
+
+        __m128 a = _mm_setzero_ps(), b = _mm_setzero_ps(), c = _mm_setzero_ps(), d = _mm_setzero_ps();
+        for (size_t j = 0; j < _width; j += 16) {
+            a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(taps + j)));
+            b = _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(x + j + 4), _mm_loadu_ps(taps + j + 4)));
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_loadu_ps(x + j + 8), _mm_loadu_ps(taps + j + 8)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(x + j + 12), _mm_loadu_ps(taps + j + 12)));
+        }
+
+        __m128 s = _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(s);
+#else
+        float partial[16] = {};
+        for (size_t j = 0; j < _width; j++)
+            partial[j % 16] += x[j] * taps[j];
+
+        float s[4];
+        for (int l = 0; l < 4; l++)
+            s[l] = (partial[l] + partial[l + 4]) + (partial[l + 8] + partial[l + 12]);
+
+        return (s[0] + s[2]) + (s[1] + s[3]);
+#endif
+    }
+
+#if WAV_SIMD_X86
+    // The same sixteen partial sums, in two registers of eight
+    WAV_TARGET_AVX2 static float dot_avx2(const float* x, const float* taps, size_t width)
+    {
+        __m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+        for (size_t j = 0; j < width; j += 16) {
+            a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(taps + j)));
+            b = _mm256_add_ps(b, _mm256_mul_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(taps + j + 8)));
+        }
+
+        __m128 ab = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        __m128 cd = _mm_add_ps(_mm256_castps256_ps128(b), _mm256_extractf128_ps(b, 1));
+        __m128 s = _mm_add_ps(ab, cd);
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(s);
+    }
+#endif
+
+    // Modified Bessel function of the first kind, order zero, by its power series
+    static double bessel_i0(double x)
+    {
+        double sum = 1, term = 1;
+        for (int k = 1; k < 64 && term > sum * 1e-17; k++) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+};
+
+// Streaming application of a Resampler to interleaved frames, block after block
+// Keeps each channel's input from the first frame the next output reads, so a signal resampled in blocks gives
+// exactly the output of resampling it whole. The number of frames out of a block varies; finish() renders the
+// last few, which read past the end of the signal (silence)
+class ResampleState {
+private:
+    std::shared_ptr<const Resampler> _resampler;
+    int _channels;
+
+    // Per channel, the input frames from _start on
+    std::vector<std::vector<float>> _input;
+    int64_t _start = 0;
+    uint64_t _received = 0;
+    uint64_t _produced = 0;
+
+public:
+    ResampleState(std::shared_ptr<const Resampler> resampler, int channels)
+        : _resampler(std::move(resampler))
+        , _channels(std::max(channels, 1))
+        , _input(_channels)
+    {
+        reset();
+    }
+
+    const Resampler& resampler() const { return *_resampler; }
+
+    // Forget everything seen so far, as if the next block started the signal
+    void reset()
+    {
+        // Silence before the first frame, as far back as the first output reads
+        for (auto& channel : _input)
+            channel.assign(_resampler->history(), 0.0f);
+
+        _start = -(int64_t)_resampler->history();
+        _received = 0;
+        _produced = 0;
+    }
+
+    // Appends the output frames the block completes to `output`; blocks must hold whole frames
+    void process(std::span<const short> block, std::vector<short>& output)
+    {
+        size_t frames = block.size() / _channels;
+        for (int channel = 0; channel < _channels; channel++)
+            for (size_t i = 0; i < frames; i++)
+                _input[channel].push_back((float)block[i * _channels + channel]);
+
+        _received += frames;
+
+        uint64_t ready = _produced;
+        while (_resampler->position(ready) + _resampler->lookahead() <= _received)
+            ready++;
+
+        render(ready, output);
+    }
+
+    // Appends the remaining output frames, for an input of the frames received so far followed by silence
+    void finish(std::vector<short>& output)
+    {
+        for (auto& channel : _input)
+            channel.resize(channel.size() + _resampler->lookahead(), 0.0f);
+
+        render(_resampler->frames(_received), output);
+    }
+
+private:
+    void render(uint64_t last, std::vector<short>& output)
+    {
+        if (last <= _produced)
+            return;
+
+        size_t offset = output.size();
+        output.resize(offset + (size_t)(last - _produced) * _channels);
+
+        for (int channel = 0; channel < _channels; channel++) {
+            // The kept frames start at input frame _start
+            _resampler->render(_input[channel].data(), _start, _produced, (size_t)(last - _produced),
+                output.data() + offset + channel, _channels);
+        }
+
+        _produced = last;
+
+        // Drop the frames no later output reads
+        int64_t keep = (int64_t)_resampler->position(_produced) - (int64_t)_resampler->history();
+        if (keep > _start) {
+            size_t drop = (size_t)(keep - _start);
+            for (auto& channel : _input)
+                channel.erase(channel.begin(), channel.begin() + (ptrdiff_t)std::min(drop, channel.size()));
+            _start = keep;
+        }
+    }
+};
+
+} // namespace wav
+
+#endif
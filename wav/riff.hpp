@@ -0,0 +1,82 @@
+#ifndef _WAV_RIFF_H
+#define _WAV_RIFF_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <vector>
+
+namespace wav {
+namespace riff {
+    struct Chunk {
+        std::array<char, 4> id;
+        uint64_t offset; // first payload byte, right after the 8-byte chunk header
+        uint32_t size; // payload size, clamped to the end of the file
+    };
+
+    // Offsets and sizes of every chunk in a RIFF file, in file order
+    struct Index {
+        std::array<char, 4> id; // "RIFF"
+        uint32_t size;
+        std::array<char, 4> form; // "WAVE"
+        std::vector<Chunk> chunks;
+
+        const Chunk* find(const char* id) const
+        {
+            for (const Chunk& chunk : chunks)
+                if (memcmp(chunk.id.data(), id, 4) == 0)
+                    return &chunk;
+
+            return nullptr;
+        }
+    };
+
+    // Walks the chunk list once, reading only the 8-byte chunk headers and seeking past every payload, so the cost
+    // does not depend on the amount of audio in the file
+    inline Index scan(std::istream& file)
+    {
+        Index index;
+
+        file.seekg(0, std::ios_base::end);
+        uint64_t length = (uint64_t)file.tellg();
+        file.seekg(0, std::ios_base::beg);
+
+        char descriptor[12];
+        if (length < 12 || file.read(descriptor, 12).gcount() != 12 || memcmp(descriptor, "RIFF", 4) != 0)
+            throw std::runtime_error("Specified file is not a RIFF file.");
+
+        memcpy(index.id.data(), descriptor, 4);
+        memcpy(&index.size, descriptor + 4, 4);
+        memcpy(index.form.data(), descriptor + 8, 4);
+
+        uint64_t position = 12;
+        while (position + 8 <= length) {
+            char header[8];
+            file.seekg((std::streamoff)position, std::ios_base::beg);
+            if (file.read(header, 8).gcount() != 8)
+                break;
+
+            Chunk chunk;
+            memcpy(chunk.id.data(), header, 4);
+            memcpy(&chunk.size, header + 4, 4);
+            chunk.offset = position + 8;
+
+            // A truncated last chunk (typically 'data' of an interrupted recording) ends with the file
+            if (chunk.offset + chunk.size > length)
+                chunk.size = (uint32_t)(length - chunk.offset);
+
+            index.chunks.push_back(chunk);
+
+            // Payloads are padded to an even number of bytes
+            position = chunk.offset + chunk.size + (chunk.size & 1);
+        }
+
+        file.clear();
+        return index;
+    }
+} // namespace riff
+} // namespace wav
+
+#endif
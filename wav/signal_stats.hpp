@@ -0,0 +1,217 @@
+#ifndef _WAV_SIGNAL_STATS_H
+#define _WAV_SIGNAL_STATS_H
+
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+namespace wav {
+
+// Summary of a block of 16-bit samples, gathered in a single pass
+// Partial results of consecutive blocks combine with merge(), exactly, in any grouping
+struct SignalStats {
+    uint64_t count = 0;
+    short min = std::numeric_limits<short>::max();
+    short max = std::numeric_limits<short>::min();
+
+    int64_t sum = 0;
+    uint64_t sum_squares = 0;
+
+    // Samples sitting at either end of the range
+    uint64_t clipped = 0;
+
+    // Largest magnitude, 32768 for a signal reaching -32768
+    int peak() const { return count ? std::max((int)max, -(int)min) : 0; }
+
+    // Sample with the largest magnitude, the positive one on ties
+    short peak_sample() const { return count == 0 ? 0 : (max >= -(int)min ? max : min); }
+
+    double dc() const { return count ? (double)sum / (double)count : 0.0; }
+    double rms() const { return count ? std::sqrt((double)sum_squares / (double)count) : 0.0; }
+
+    void merge(const SignalStats& other)
+    {
+        count += other.count;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+        sum_squares += other.sum_squares;
+        clipped += other.clipped;
+    }
+};
+
+// Filters whose per-sample function never changes direction can tell which one it takes: monotonic() returns 1
+// for non-decreasing, -1 for non-increasing and 0 for neither. Extrema then survive the filter without a rescan
+template <typename Filter>
+concept MonotonicFilter = requires(const Filter& filter) {
+    { filter.monotonic() } -> std::convertible_to<int>;
+};
+
+namespace simd {
+    inline void summarize_scalar(const short* data, size_t count, SignalStats& stats)
+    {
+        for (size_t i = 0; i < count; i++) {
+            short sample = data[i];
+
+            stats.min = std::min(stats.min, sample);
+            stats.max = std::max(stats.max, sample);
+            stats.sum += sample;
+            stats.sum_squares += (uint64_t)((int)sample * sample);
+            stats.clipped += (sample == std::numeric_limits<short>::max() || sample == std::numeric_limits<short>::min());
+        }
+
+        stats.count += count;
+    }
+
+#if WAV_SIMD_X86
+    namespace detail {
+        // Vectors per run: the 32-bit sums (at most 2 * 32768 per vector) and the 16-bit clip counters
+        // cannot overflow within one
+        constexpr size_t summary_run = 8192;
+
+        inline void summarize_sse2(const short* data, size_t count, SignalStats& stats)
+        {
+            const __m128i ones = _mm_set1_epi16(1), zero = _mm_setzero_si128();
+            const __m128i top = _mm_set1_epi16(std::numeric_limits<short>::max());
+            const __m128i bottom = _mm_set1_epi16(std::numeric_limits<short>::min());
+
+            __m128i min = top, max = bottom, sum = zero, squares = zero, clipped = zero;
+            size_t i = 0;
+
+            while (i + 8 <= count) {
+                size_t end = i + std::min((count - i) / 8, summary_run) * 8;
+                __m128i sum32 = zero, clipped16 = zero;
+
+                for (; i < end; i += 8) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+
+                    min = _mm_min_epi16(min, v);
+                    max = _mm_max_epi16(max, v);
+                    sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(v, ones));
+
+                    // Pairs of squares reach 2^31, so they are widened as unsigned straight away
+                    __m128i square = _mm_madd_epi16(v, v);
+                    squares = _mm_add_epi64(squares, _mm_unpacklo_epi32(square, zero));
+                    squares = _mm_add_epi64(squares, _mm_unpackhi_epi32(square, zero));
+
+                    // Comparisons yield -1 per match
+                    clipped16 = _mm_sub_epi16(clipped16, _mm_or_si128(_mm_cmpeq_epi16(v, top), _mm_cmpeq_epi16(v, bottom)));
+                }
+
+                __m128i sign = _mm_srai_epi32(sum32, 31);
+                sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(sum32, sign));
+                sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(sum32, sign));
+
+                __m128i clipped32 = _mm_madd_epi16(clipped16, ones);
+                clipped = _mm_add_epi64(clipped, _mm_unpacklo_epi32(clipped32, zero));
+                clipped = _mm_add_epi64(clipped, _mm_unpackhi_epi32(clipped32, zero));
+            }
+
+            alignas(16) short mins[8], maxs[8];
+            alignas(16) int64_t sums[2];
+            alignas(16) uint64_t square_sums[2], clip_counts[2];
+
+            _mm_store_si128((__m128i*)mins, min);
+            _mm_store_si128((__m128i*)maxs, max);
+            _mm_store_si128((__m128i*)sums, sum);
+            _mm_store_si128((__m128i*)square_sums, squares);
+            _mm_store_si128((__m128i*)clip_counts, clipped);
+
+            for (int lane = 0; lane < 8; lane++) {
+                stats.min = std::min(stats.min, mins[lane]);
+                stats.max = std::max(stats.max, maxs[lane]);
+            }
+
+            stats.sum += sums[0] + sums[1];
+            stats.sum_squares += square_sums[0] + square_sums[1];
+            stats.clipped += clip_counts[0] + clip_counts[1];
+            stats.count += i;
+
+            summarize_scalar(data + i, count - i, stats);
+        }
+
+        WAV_TARGET_AVX2 inline void summarize_avx2(const short* data, size_t count, SignalStats& stats)
+        {
+            const __m256i ones = _mm256_set1_epi16(1), zero = _mm256_setzero_si256();
+            const __m256i top = _mm256_set1_epi16(std::numeric_limits<short>::max());
+            const __m256i bottom = _mm256_set1_epi16(std::numeric_limits<short>::min());
+
+            __m256i min = top, max = bottom, sum = zero, squares = zero, clipped = zero;
+            size_t i = 0;
+
+            while (i + 16 <= count) {
+                size_t end = i + std::min((count - i) / 16, summary_run) * 16;
+                __m256i sum32 = zero, clipped16 = zero;
+
+                for (; i < end; i += 16) {
+                    __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+
+                    min = _mm256_min_epi16(min, v);
+                    max = _mm256_max_epi16(max, v);
+                    sum32 = _mm256_add_epi32(sum32, _mm256_madd_epi16(v, ones));
+
+                    __m256i square = _mm256_madd_epi16(v, v);
+                    squares = _mm256_add_epi64(squares, _mm256_unpacklo_epi32(square, zero));
+                    squares = _mm256_add_epi64(squares, _mm256_unpackhi_epi32(square, zero));
+
+                    __m256i edge = _mm256_or_si256(_mm256_cmpeq_epi16(v, top), _mm256_cmpeq_epi16(v, bottom));
+                    clipped16 = _mm256_sub_epi16(clipped16, edge);
+                }
+
+                __m256i sign = _mm256_srai_epi32(sum32, 31);
+                sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(sum32, sign));
+                sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(sum32, sign));
+
+                __m256i clipped32 = _mm256_madd_epi16(clipped16, ones);
+                clipped = _mm256_add_epi64(clipped, _mm256_unpacklo_epi32(clipped32, zero));
+                clipped = _mm256_add_epi64(clipped, _mm256_unpackhi_epi32(clipped32, zero));
+            }
+
+            alignas(32) short mins[16], maxs[16];
+            alignas(32) int64_t sums[4];
+            alignas(32) uint64_t square_sums[4], clip_counts[4];
+
+            _mm256_store_si256((__m256i*)mins, min);
+            _mm256_store_si256((__m256i*)maxs, max);
+            _mm256_store_si256((__m256i*)sums, sum);
+            _mm256_store_si256((__m256i*)square_sums, squares);
+            _mm256_store_si256((__m256i*)clip_counts, clipped);
+
+            for (int lane = 0; lane < 16; lane++) {
+                stats.min = std::min(stats.min, mins[lane]);
+                stats.max = std::max(stats.max, maxs[lane]);
+            }
+
+            for (int lane = 0; lane < 4; lane++) {
+                stats.sum += sums[lane];
+                stats.sum_squares += square_sums[lane];
+                stats.clipped += clip_counts[lane];
+            }
+
+            stats.count += i;
+
+            summarize_scalar(data + i, count - i, stats);
+        }
+    } // namespace detail
+#endif
+
+    // Adds `count` samples to `stats`
+    inline void summarize(const short* data, size_t count, SignalStats& stats)
+    {
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::summarize_avx2(data, count, stats);
+
+        return detail::summarize_sse2(data, count, stats);
+#else
+        summarize_scalar(data, count, stats);
+#endif
+    }
+} // namespace simd
+
+} // namespace wav
+
+#endif
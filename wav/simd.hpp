@@ -0,0 +1,486 @@
+#ifndef _WAV_SIMD_H
+#define _WAV_SIMD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define WAV_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define WAV_SIMD_X86 0
+#endif
+
+// AVX2 kernels are compiled for AVX2 regardless of the global target, and only called when the CPU supports it
+#if defined(__GNUC__) || defined(__clang__)
+#define WAV_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define WAV_TARGET_AVX2
+#endif
+
+// Block kernels over 16-bit samples, with saturating arithmetic
+// Each kernel has a scalar reference (the per-sample helpers below), an SSE2 path (baseline on x86-64) and an AVX2
+// path, selected once at runtime. All paths produce bit-identical results
+namespace wav {
+namespace simd {
+    enum class Level {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    inline Level detect()
+    {
+#if WAV_SIMD_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return Level::SSE2;
+
+        // AVX2 needs both the instruction set and the OS saving the YMM state
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (osxsave == false || (_xgetbv(0) & 0x6) != 0x6)
+            return Level::SSE2;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0 ? Level::AVX2 : Level::SSE2;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? Level::AVX2 : Level::SSE2;
+#endif
+#else
+        return Level::Scalar;
+#endif
+    }
+
+    inline Level level()
+    {
+        static const Level detected = detect();
+        return detected;
+    }
+
+    // === Scalar references === //
+
+    // Q15 product with rounding, matches pmulhrsw: (s * q + 2^14) >> 15, q must not be -32768
+    inline short scale_q15(short sample, short q15) { return (short)(((int)sample * q15 + 0x4000) >> 15); }
+
+    // Float product, saturated and truncated towards zero
+    inline short scale_float(short sample, float factor)
+    {
+        float value = std::clamp((float)sample * factor, -32768.0f, 32767.0f);
+        return (short)value;
+    }
+
+    // Samples with |sample| >= bound are snapped to full scale, bound > 32768 leaves everything untouched
+    inline short pulse(short sample, int bound)
+    {
+        if (sample > -bound && sample < bound)
+            return sample;
+
+        return sample < 0 ? std::numeric_limits<short>::min() : std::numeric_limits<short>::max();
+    }
+
+    // Float sum rounded to the nearest sample (ties to even), saturated
+    inline short quantize(float value)
+    {
+        return (short)std::lrint(std::clamp(value, -32768.0f, 32767.0f));
+    }
+
+#if WAV_SIMD_X86
+    namespace detail {
+        inline void clip_sse2(short* data, size_t count, short low, short high)
+        {
+            const __m128i lo = _mm_set1_epi16(low), hi = _mm_set1_epi16(high);
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+                _mm_storeu_si128((__m128i*)(data + i), _mm_min_epi16(_mm_max_epi16(v, lo), hi));
+            }
+
+            for (; i < count; i++)
+                data[i] = std::clamp(data[i], low, high);
+        }
+
+        WAV_TARGET_AVX2 inline void clip_avx2(short* data, size_t count, short low, short high)
+        {
+            const __m256i lo = _mm256_set1_epi16(low), hi = _mm256_set1_epi16(high);
+            size_t i = 0;
+
+            for (; i + 16 <= count; i += 16) {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+                _mm256_storeu_si256((__m256i*)(data + i), _mm256_min_epi16(_mm256_max_epi16(v, lo), hi));
+            }
+
+            for (; i < count; i++)
+                data[i] = std::clamp(data[i], low, high);
+        }
+
+        inline void scale_q15_sse2(short* data, size_t count, short q15)
+        {
+            // SSE2 has no pmulhrsw, build the rounded product from the full 32-bit one
+            const __m128i q = _mm_set1_epi16(q15), round = _mm_set1_epi32(0x4000);
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+                __m128i lo = _mm_mullo_epi16(v, q), hi = _mm_mulhi_epi16(v, q);
+
+                __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 15);
+                __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 15);
+
+                _mm_storeu_si128((__m128i*)(data + i), _mm_packs_epi32(p0, p1));
+            }
+
+            for (; i < count; i++)
+                data[i] = scale_q15(data[i], q15);
+        }
+
+        WAV_TARGET_AVX2 inline void scale_q15_avx2(short* data, size_t count, short q15)
+        {
+            const __m256i q = _mm256_set1_epi16(q15);
+            size_t i = 0;
+
+            for (; i + 16 <= count; i += 16) {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+                _mm256_storeu_si256((__m256i*)(data + i), _mm256_mulhrs_epi16(v, q));
+            }
+
+            for (; i < count; i++)
+                data[i] = scale_q15(data[i], q15);
+        }
+
+        inline void scale_float_sse2(short* data, size_t count, float factor)
+        {
+            const __m128 f = _mm_set1_ps(factor), lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+            size_t i = 0;
+
+            auto scale = [&](__m128i v) {
+                __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(v), f);
+                return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, lo), hi));
+            };
+
+            for (; i + 8 <= count; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+
+                // Sign-extend to 32 bits by unpacking with itself and shifting
+                __m128i v0 = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i v1 = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+                _mm_storeu_si128((__m128i*)(data + i), _mm_packs_epi32(scale(v0), scale(v1)));
+            }
+
+            for (; i < count; i++)
+                data[i] = scale_float(data[i], factor);
+        }
+
+        WAV_TARGET_AVX2 inline void scale_float_avx2(short* data, size_t count, float factor)
+        {
+            const __m256 f = _mm256_set1_ps(factor), lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+            size_t i = 0;
+
+            for (; i + 16 <= count; i += 16) {
+                __m256i v0 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(data + i)));
+                __m256i v1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(data + i + 8)));
+
+                __m256 x0 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v0), f), lo), hi);
+                __m256 x1 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v1), f), lo), hi);
+
+                // packs works per 128-bit lane, restore the sample order afterwards
+                __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(x0), _mm256_cvttps_epi32(x1));
+                _mm256_storeu_si256((__m256i*)(data + i), _mm256_permute4x64_epi64(packed, 0xD8));
+            }
+
+            for (; i < count; i++)
+                data[i] = scale_float(data[i], factor);
+        }
+
+        inline void pulse_sse2(short* data, size_t count, int bound)
+        {
+            // pulse where sample >= bound or sample <= -bound; target is MAX, or MIN for negative samples
+            const __m128i above = _mm_set1_epi16((short)(bound - 1)), below = _mm_set1_epi16((short)(1 - bound));
+            const __m128i zero = _mm_setzero_si128(), max = _mm_set1_epi16(std::numeric_limits<short>::max());
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+
+                __m128i mask = _mm_or_si128(_mm_cmpgt_epi16(v, above), _mm_cmplt_epi16(v, below));
+                __m128i target = _mm_xor_si128(max, _mm_cmplt_epi16(v, zero));
+
+                _mm_storeu_si128((__m128i*)(data + i), _mm_or_si128(_mm_and_si128(mask, target), _mm_andnot_si128(mask, v)));
+            }
+
+            for (; i < count; i++)
+                data[i] = pulse(data[i], bound);
+        }
+
+        WAV_TARGET_AVX2 inline void pulse_avx2(short* data, size_t count, int bound)
+        {
+            const __m256i above = _mm256_set1_epi16((short)(bound - 1)), below = _mm256_set1_epi16((short)(1 - bound));
+            const __m256i zero = _mm256_setzero_si256(), max = _mm256_set1_epi16(std::numeric_limits<short>::max());
+            size_t i = 0;
+
+            for (; i + 16 <= count; i += 16) {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+
+                __m256i mask = _mm256_or_si256(_mm256_cmpgt_epi16(v, above), _mm256_cmpgt_epi16(below, v));
+                __m256i target = _mm256_xor_si256(max, _mm256_cmpgt_epi16(zero, v));
+
+                _mm256_storeu_si256((__m256i*)(data + i), _mm256_blendv_epi8(v, target, mask));
+            }
+
+            for (; i < count; i++)
+                data[i] = pulse(data[i], bound);
+        }
+
+        // Gains for 8 consecutive samples, repeating with the channels
+        inline void mix_sse2(float* sum, const short* samples, size_t count, const float* pattern)
+        {
+            const __m128 g0 = _mm_loadu_ps(pattern), g1 = _mm_loadu_ps(pattern + 4);
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+                __m128 x0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+                __m128 x1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+
+                _mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(x0, g0)));
+                _mm_storeu_ps(sum + i + 4, _mm_add_ps(_mm_loadu_ps(sum + i + 4), _mm_mul_ps(x1, g1)));
+            }
+
+            for (; i < count; i++)
+                sum[i] += (float)samples[i] * pattern[i % 8];
+        }
+
+        WAV_TARGET_AVX2 inline void mix_avx2(float* sum, const short* samples, size_t count, const float* pattern)
+        {
+            const __m256 g = _mm256_loadu_ps(pattern);
+            size_t i = 0;
+
+            for (; i + 16 <= count; i += 16) {
+                __m256 x0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples + i))));
+                __m256 x1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples + i + 8))));
+
+                _mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_mul_ps(x0, g)));
+                _mm256_storeu_ps(sum + i + 8, _mm256_add_ps(_mm256_loadu_ps(sum + i + 8), _mm256_mul_ps(x1, g)));
+            }
+
+            for (; i < count; i++)
+                sum[i] += (float)samples[i] * pattern[i % 8];
+        }
+
+        inline void spread_sse2(float* sum, const short* mono, size_t frames, float left, float right)
+        {
+            const __m128 g = _mm_setr_ps(left, right, left, right);
+            size_t i = 0;
+
+            for (; i + 8 <= frames; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(mono + i));
+                __m128 x[2] = { _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)),
+                    _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)) };
+
+                // Every sample twice, once per side
+                float* out = sum + 2 * i;
+                for (int half = 0; half < 2; half++, out += 8) {
+                    __m128 lo = _mm_unpacklo_ps(x[half], x[half]), hi = _mm_unpackhi_ps(x[half], x[half]);
+                    _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(lo, g)));
+                    _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(hi, g)));
+                }
+            }
+
+            for (; i < frames; i++) {
+                sum[2 * i] += (float)mono[i] * left;
+                sum[2 * i + 1] += (float)mono[i] * right;
+            }
+        }
+
+        WAV_TARGET_AVX2 inline void spread_avx2(float* sum, const short* mono, size_t frames, float left, float right)
+        {
+            const __m256 g = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+            size_t i = 0;
+
+            for (; i + 8 <= frames; i += 8) {
+                __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(mono + i))));
+
+                // unpack works per 128-bit lane: lo holds samples 0, 1 | 4, 5 twice each, hi 2, 3 | 6, 7
+                __m256 lo = _mm256_unpacklo_ps(x, x), hi = _mm256_unpackhi_ps(x, x);
+                __m256 first = _mm256_permute2f128_ps(lo, hi, 0x20), second = _mm256_permute2f128_ps(lo, hi, 0x31);
+
+                float* out = sum + 2 * i;
+                _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), _mm256_mul_ps(first, g)));
+                _mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(second, g)));
+            }
+
+            for (; i < frames; i++) {
+                sum[2 * i] += (float)mono[i] * left;
+                sum[2 * i + 1] += (float)mono[i] * right;
+            }
+        }
+
+        inline void quantize_sse2(short* data, const float* sum, size_t count)
+        {
+            const __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                __m128i v0 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(sum + i), lo), hi));
+                __m128i v1 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(sum + i + 4), lo), hi));
+                _mm_storeu_si128((__m128i*)(data + i), _mm_packs_epi32(v0, v1));
+            }
+
+            for (; i < count; i++)
+                data[i] = quantize(sum[i]);
+        }
+
+        WAV_TARGET_AVX2 inline void quantize_avx2(short* data, const float* sum, size_t count)
+        {
+            const __m256 lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+            size_t i = 0;
+
+            for (; i + 16 <= count; i += 16) {
+                __m256i v0 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(sum + i), lo), hi));
+                __m256i v1 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(sum + i + 8), lo), hi));
+
+                __m256i packed = _mm256_packs_epi32(v0, v1);
+                _mm256_storeu_si256((__m256i*)(data + i), _mm256_permute4x64_epi64(packed, 0xD8));
+            }
+
+            for (; i < count; i++)
+                data[i] = quantize(sum[i]);
+        }
+    } // namespace detail
+#endif
+
+    // === Dispatched block kernels === //
+
+    inline void clip(short* data, size_t count, short low, short high)
+    {
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::clip_avx2(data, count, low, high);
+
+        return detail::clip_sse2(data, count, low, high);
+#else
+        for (size_t i = 0; i < count; i++)
+            data[i] = std::clamp(data[i], low, high);
+#endif
+    }
+
+    inline void scale_q15(short* data, size_t count, short q15)
+    {
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::scale_q15_avx2(data, count, q15);
+
+        return detail::scale_q15_sse2(data, count, q15);
+#else
+        for (size_t i = 0; i < count; i++)
+            data[i] = scale_q15(data[i], q15);
+#endif
+    }
+
+    inline void scale_float(short* data, size_t count, float factor)
+    {
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::scale_float_avx2(data, count, factor);
+
+        return detail::scale_float_sse2(data, count, factor);
+#else
+        for (size_t i = 0; i < count; i++)
+            data[i] = scale_float(data[i], factor);
+#endif
+    }
+
+    inline void pulse(short* data, size_t count, int bound)
+    {
+        if (bound > 32768)
+            return;
+
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::pulse_avx2(data, count, bound);
+
+        return detail::pulse_sse2(data, count, bound);
+#else
+        for (size_t i = 0; i < count; i++)
+            data[i] = pulse(data[i], bound);
+#endif
+    }
+
+    // sum[i] += samples[i] * gains[i % period]: interleaved samples added into float sums, with a gain per channel
+    // Periods of 1, 2, 4 and 8 channels are vectorized
+    inline void mix(float* sum, const short* samples, size_t count, const float* gains, size_t period)
+    {
+#if WAV_SIMD_X86
+        if (period > 0 && 8 % period == 0) {
+            float pattern[8];
+            for (size_t i = 0; i < 8; i++)
+                pattern[i] = gains[i % period];
+
+            if (level() == Level::AVX2)
+                return detail::mix_avx2(sum, samples, count, pattern);
+
+            return detail::mix_sse2(sum, samples, count, pattern);
+        }
+#endif
+        for (size_t i = 0; i < count; i++)
+            sum[i] += (float)samples[i] * gains[i % period];
+    }
+
+    // Mono samples added into interleaved stereo sums, with a gain per side
+    inline void spread(float* sum, const short* mono, size_t frames, float left, float right)
+    {
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::spread_avx2(sum, mono, frames, left, right);
+
+        return detail::spread_sse2(sum, mono, frames, left, right);
+#else
+        for (size_t i = 0; i < frames; i++) {
+            sum[2 * i] += (float)mono[i] * left;
+            sum[2 * i + 1] += (float)mono[i] * right;
+        }
+#endif
+    }
+
+    // Float sums back to samples, see quantize(float)
+    inline void quantize(short* data, const float* sum, size_t count)
+    {
+#if WAV_SIMD_X86
+        if (level() == Level::AVX2)
+            return detail::quantize_avx2(data, sum, count);
+
+        return detail::quantize_sse2(data, sum, count);
+#else
+        for (size_t i = 0; i < count; i++)
+            data[i] = quantize(sum[i]);
+#endif
+    }
+
+    // Gain factors with |factor| < 1 fit Q15 and use the (cheaper) fixed-point product, others go through float
+    // Returns 0 when the factor needs the float path
+    inline short q15_factor(float factor)
+    {
+        if (!(std::abs(factor) < 1.0f))
+            return 0;
+
+        long q = std::lrint(factor * 32768.0f);
+        if (q <= -32768 || q > 32767 || q == 0)
+            return 0;
+
+        return (short)q;
+    }
+} // namespace simd
+} // namespace wav
+
+#endif
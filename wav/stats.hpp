@@ -0,0 +1,142 @@
+#ifndef _WAV_STATS_H
+#define _WAV_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace wav {
+
+// Per-stage timing of a Waveform's hot paths, compiled in with -DWAV_STATS
+// Without it, the timers are empty objects and every stats() is empty, so the instrumentation costs nothing
+#ifdef WAV_STATS
+inline constexpr bool stats_enabled = true;
+#else
+inline constexpr bool stats_enabled = false;
+#endif
+
+class Stats {
+public:
+    enum class Kind {
+        IO,
+        Compute
+    };
+
+    struct Record {
+        const char* stage;
+        Kind kind;
+        uint64_t nanoseconds;
+        uint64_t bytes;
+        uint64_t samples;
+    };
+
+    struct Totals {
+        uint64_t calls = 0;
+        uint64_t nanoseconds = 0;
+        uint64_t bytes = 0;
+        uint64_t samples = 0;
+    };
+
+private:
+    std::vector<Record> _records;
+
+public:
+    void record(const Record& record) { _records.push_back(record); }
+    void clear() { _records.clear(); }
+
+    // Every timed call, in the order it completed
+    const std::vector<Record>& records() const { return _records; }
+
+    Totals totals(Kind kind) const
+    {
+        Totals sum;
+        for (const Record& record : _records)
+            if (record.kind == kind)
+                add(sum, record);
+
+        return sum;
+    }
+
+    // {"enabled":..,"io_ns":..,"compute_ns":..,"stages":{"filter":{"calls":..,..},..},"records":[..]}
+    std::ostream& json(std::ostream& os) const
+    {
+        os << "{\"enabled\":" << (stats_enabled ? "true" : "false");
+        os << ",\"io_ns\":" << totals(Kind::IO).nanoseconds << ",\"compute_ns\":" << totals(Kind::Compute).nanoseconds;
+
+        // Per-stage totals, stages in order of first appearance
+        os << ",\"stages\":{";
+        std::vector<const char*> seen;
+        for (const Record& record : _records) {
+            bool first = true;
+            for (const char* stage : seen)
+                first = first && std::string_view(stage) != record.stage;
+            if (first == false)
+                continue;
+
+            Totals sum;
+            for (const Record& other : _records)
+                if (std::string_view(other.stage) == record.stage)
+                    add(sum, other);
+
+            os << (seen.empty() ? "" : ",") << "\"" << record.stage << "\":{\"calls\":" << sum.calls
+               << ",\"ns\":" << sum.nanoseconds << ",\"bytes\":" << sum.bytes << ",\"samples\":" << sum.samples << "}";
+            seen.push_back(record.stage);
+        }
+
+        os << "},\"records\":[";
+        for (size_t i = 0; i < _records.size(); i++) {
+            const Record& record = _records[i];
+            os << (i ? "," : "") << "{\"stage\":\"" << record.stage << "\",\"ns\":" << record.nanoseconds
+               << ",\"bytes\":" << record.bytes << ",\"samples\":" << record.samples << "}";
+        }
+
+        return os << "]}";
+    }
+
+private:
+    static void add(Totals& sum, const Record& record)
+    {
+        sum.calls++;
+        sum.nanoseconds += record.nanoseconds;
+        sum.bytes += record.bytes;
+        sum.samples += record.samples;
+    }
+};
+
+// Measures from construction to done(), and files the result under `stage`
+class StageTimer {
+#ifdef WAV_STATS
+private:
+    Stats* _stats;
+    const char* _stage;
+    Stats::Kind _kind;
+    std::chrono::steady_clock::time_point _start;
+
+public:
+    StageTimer(Stats* stats, const char* stage, Stats::Kind kind)
+        : _stats(stats)
+        , _stage(stage)
+        , _kind(kind)
+        , _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    void done(uint64_t bytes, uint64_t samples)
+    {
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        auto nanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+        _stats->record({ _stage, _kind, nanoseconds, bytes, samples });
+    }
+#else
+public:
+    StageTimer(Stats*, const char*, Stats::Kind) { }
+    void done(uint64_t, uint64_t) { }
+#endif
+};
+
+} // namespace wav
+
+#endif
@@ -0,0 +1,487 @@
+#ifndef _WAV_STFT_H
+#define _WAV_STFT_H
+
+#include "fft.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Short-time Fourier analysis of 16-bit signals
+// Frame f covers samples [f * hop, f * hop + size) of every channel, zero past the end of the signal, and is
+// multiplied by a window before its FFT. Magnitudes are relative to full scale: a full-scale sine centred on a bin
+// reads 1 there (0 dBFS) whatever the window, so levels can be compared between settings
+// The FFT plan of a size is built once and shared by every analysis and thread (see fft::Plan::get); each task
+// of frames works in scratch buffers from its thread's pool
+namespace wav {
+namespace stft {
+    enum class Window {
+        Rectangular,
+        Hann,
+        Hamming,
+        Blackman
+    };
+
+    struct Settings {
+        // FFT length, a power of two of at least 4
+        size_t size = 2048;
+
+        // Samples from the start of one frame to the next
+        size_t hop = 512;
+
+        Window window = Window::Hann;
+    };
+
+    // Level of a magnitude in dB relative to full scale, silence reads -240
+    inline float decibels(float magnitude) { return 20 * std::log10(std::max(magnitude, 1e-12f)); }
+
+    // Turns samples into magnitude frames for fixed settings
+    // Immutable after construction, one analyzer can be shared between files and threads
+    class Analyzer {
+    private:
+        Settings _settings;
+        std::shared_ptr<const fft::Plan> _plan;
+
+        // Window coefficients, with the full-scale normalization folded in
+        std::vector<float> _window;
+
+    public:
+        // Fewest frames rendered together before they are handed to the sink
+        static constexpr size_t chunk = 64;
+
+        // Throws std::invalid_argument for a size that is not a power of two or a zero hop
+        explicit Analyzer(const Settings& settings = {})
+            : _settings(settings)
+        {
+            if (settings.hop == 0)
+                throw std::invalid_argument("STFT hop must be at least one sample.");
+
+            _plan = fft::Plan::get(settings.size);
+            _window.resize(settings.size);
+
+            // Periodic windows, so that overlapping frames at the usual hops add up to a constant
+            double sum = 0;
+            for (size_t i = 0; i < settings.size; i++) {
+                double phase = 2 * std::numbers::pi_v<double> * (double)i / (double)settings.size;
+                double w = 1;
+
+                if (settings.window == Window::Hann)
+                    w = 0.5 - 0.5 * std::cos(phase);
+                else if (settings.window == Window::Hamming)
+                    w = 0.54 - 0.46 * std::cos(phase);
+                else if (settings.window == Window::Blackman)
+                    w = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2 * phase);
+
+                _window[i] = (float)w;
+                sum += w;
+            }
+
+            // A sine of amplitude A centred on a bin sums to A * sum(w) / 2 there
+            double scale = 2 / (sum * 32768.0);
+            for (float& w : _window)
+                w = (float)(w * scale);
+        }
+
+        const Settings& settings() const { return _settings; }
+        size_t size() const { return _settings.size; }
+        size_t hop() const { return _settings.hop; }
+
+        // Magnitudes per frame and channel, DC to Nyquist
+        size_t bins() const { return _plan->bins(); }
+
+        // Centre frequency of a bin, in Hz
+        double frequency(size_t bin, int sample_rate) const { return (double)bin * sample_rate / (double)size(); }
+
+        // Frames of a signal `length` samples long: every frame starting within it
+        uint64_t frames(uint64_t length) const { return (length + hop() - 1) / hop(); }
+
+        // Calls sink(frame, magnitudes) for every frame of a whole signal, in order, with channels.size() * bins()
+        // magnitudes, channel after channel. Sample i of channel c is channels[c][i * stride], `length` of them
+        // Frames are spread across the configured workers a chunk of them at a time, so memory stays bounded
+        template <typename Sink>
+        void process(std::span<const short* const> channels, size_t length, size_t stride, Sink sink,
+            const Parallelism& parallelism = {}) const
+        {
+            int count = (int)channels.size();
+            uint64_t total = frames(length);
+            size_t batch = frames_per_batch(parallelism, count);
+
+            // Window past the end of the signal reads silence
+            auto fill = [&](uint64_t frame, int channel, float* samples) {
+                size_t begin = (size_t)frame * hop();
+                size_t available = begin < length ? std::min(size(), length - begin) : 0;
+                const short* source = channels[channel] + begin * stride;
+
+                for (size_t i = 0; i < available; i++)
+                    samples[i] = (float)source[i * stride];
+                std::fill(samples + available, samples + size(), 0.0f);
+            };
+
+            std::pmr::vector<float> output(batch * count * bins(), &memory::local());
+            for (uint64_t first = 0; first < total; first += batch) {
+                size_t rendered = (size_t)std::min<uint64_t>(batch, total - first);
+                render(first, rendered, count, output.data(), parallelism, fill);
+                emit(first, rendered, count, output.data(), sink);
+            }
+        }
+
+        // Magnitudes of frames [first, first + count) into output, each channels * bins() of them
+        // fill(frame, channel, samples) stores the size() samples of a frame; frames and channels are independent,
+        // so they are split across the configured workers
+        template <typename Fill>
+        void render(uint64_t first, size_t count, int channels, float* output, const Parallelism& parallelism,
+            Fill fill) const
+        {
+            // A frame reads size() samples, so a task gets about `grain` samples' worth of frames
+            Parallelism tasks = parallelism;
+            tasks.grain = std::max<size_t>(parallelism.grain / size(), 1);
+
+            parallel_for(count * channels, tasks, [&](size_t, size_t begin, size_t end) {
+                // Scratch comes from the calling thread's pool, reused by every frame of the task
+                std::pmr::vector<float> samples(size(), &memory::local());
+                std::pmr::vector<fft::complex> spectrum(bins(), &memory::local());
+
+                for (size_t item = begin; item < end; item++) {
+                    fill(first + item / channels, (int)(item % channels), samples.data());
+                    transform(samples.data(), spectrum.data(), output + item * bins());
+                }
+            });
+        }
+
+        // Frames rendered together, so every worker has a few tasks of frames at a time
+        size_t frames_per_batch(const Parallelism& parallelism, int channels) const
+        {
+            size_t grain = std::max<size_t>(parallelism.grain / size(), 1);
+            size_t batch = parallelism.workers() * grain * 4 / std::max(channels, 1);
+            return std::max(batch, chunk);
+        }
+
+        // Hands `count` rendered frames to the sink, in order
+        template <typename Sink>
+        void emit(uint64_t first, size_t count, int channels, const float* output, Sink& sink) const
+        {
+            size_t width = (size_t)channels * bins();
+            for (size_t k = 0; k < count; k++)
+                sink(first + k, std::span<const float>(output + k * width, width));
+        }
+
+    private:
+        void transform(float* samples, fft::complex* spectrum, float* magnitudes) const
+        {
+            const float* window = _window.data();
+            for (size_t i = 0; i < size(); i++)
+                samples[i] *= window[i];
+
+            _plan->forward(samples, spectrum);
+
+            const float* bins = reinterpret_cast<const float*>(spectrum);
+            for (size_t k = 0; k < this->bins(); k++)
+                magnitudes[k] = std::sqrt(bins[2 * k] * bins[2 * k] + bins[2 * k + 1] * bins[2 * k + 1]);
+
+            // DC and Nyquist have no mirror image, the window scale counts both halves
+            magnitudes[0] *= 0.5f;
+            magnitudes[this->bins() - 1] *= 0.5f;
+        }
+    };
+
+    // Streaming analysis of interleaved frames, block after block
+    // Keeps each channel's samples from the start of the next frame on, so a signal analyzed in blocks gives
+    // exactly the frames of analyzing it whole. finish() renders the last few, which reach past its end
+    class State {
+    private:
+        Analyzer _analyzer;
+        int _channels;
+
+        // Per channel, the samples from _start on
+        std::vector<std::vector<float>> _input;
+        uint64_t _start = 0;
+        uint64_t _received = 0;
+        uint64_t _produced = 0;
+
+        std::vector<float> _output;
+
+    public:
+        State(const Analyzer& analyzer, int channels)
+            : _analyzer(analyzer)
+            , _channels(std::max(channels, 1))
+            , _input(_channels)
+        {
+        }
+
+        const Analyzer& analyzer() const { return _analyzer; }
+
+        // Forget everything seen so far, as if the next block started the signal
+        void reset()
+        {
+            for (auto& channel : _input)
+                channel.clear();
+
+            _start = 0;
+            _received = 0;
+            _produced = 0;
+        }
+
+        // Calls sink(frame, magnitudes) for every frame the block completes; blocks must hold whole frames
+        template <typename Sink>
+        void process(std::span<const short> block, Sink sink, const Parallelism& parallelism = {})
+        {
+            size_t frames = block.size() / _channels;
+            for (int channel = 0; channel < _channels; channel++) {
+                auto& input = _input[channel];
+                size_t offset = input.size();
+
+                input.resize(offset + frames);
+                for (size_t i = 0; i < frames; i++)
+                    input[offset + i] = (float)block[i * _channels + channel];
+            }
+
+            _received += frames;
+
+            // Frames whose last sample has arrived
+            uint64_t ready = _received >= _analyzer.size() ? (_received - _analyzer.size()) / _analyzer.hop() + 1 : 0;
+            render(ready, sink, parallelism);
+        }
+
+        // Calls sink for the remaining frames, of the samples received so far followed by silence
+        template <typename Sink>
+        void finish(Sink sink, const Parallelism& parallelism = {})
+        {
+            render(_analyzer.frames(_received), sink, parallelism);
+        }
+
+    private:
+        template <typename Sink>
+        void render(uint64_t last, Sink& sink, const Parallelism& parallelism)
+        {
+            auto fill = [this](uint64_t frame, int channel, float* samples) {
+                const auto& input = _input[channel];
+                size_t begin = (size_t)(frame * _analyzer.hop() - _start);
+                size_t available = begin < input.size() ? std::min(_analyzer.size(), input.size() - begin) : 0;
+
+                std::copy(input.begin() + begin, input.begin() + begin + available, samples);
+                std::fill(samples + available, samples + _analyzer.size(), 0.0f);
+            };
+
+            size_t batch = _analyzer.frames_per_batch(parallelism, _channels);
+            while (_produced < last) {
+                size_t count = (size_t)std::min<uint64_t>(batch, last - _produced);
+                _output.resize(count * _channels * _analyzer.bins());
+
+                _analyzer.render(_produced, count, _channels, _output.data(), parallelism, fill);
+                _analyzer.emit(_produced, count, _channels, _output.data(), sink);
+                _produced += count;
+            }
+
+            // Drop the samples no later frame reads
+            uint64_t keep = std::min(_produced * _analyzer.hop(), _received);
+            if (keep > _start) {
+                size_t drop = (size_t)(keep - _start);
+                for (auto& channel : _input)
+                    channel.erase(channel.begin(), channel.begin() + (ptrdiff_t)std::min(drop, channel.size()));
+                _start = keep;
+            }
+        }
+    };
+
+    // Compact spectrogram file: a 40-byte header, then one byte per magnitude, frame after frame and channel after
+    // channel. A byte holds the level in `step` dB above `floor` dBFS, 0 at or below the floor and 255 at or above
+    // floor + 255 * step (-120 to +7.5 dBFS in 0.5 dB steps by default)
+    // Header fields, native (little-endian) byte order: "WSPG", version and channels (16 bits), sample rate, size,
+    // hop and bins (32 bits), frames (64 bits), floor and step (32-bit floats)
+    struct SpectrogramHeader {
+        static constexpr size_t bytes = 40;
+
+        uint16_t version = 1;
+        uint16_t channels = 1;
+        uint32_t sample_rate = 0;
+        uint32_t size = 0;
+        uint32_t hop = 0;
+        uint32_t bins = 0;
+        uint64_t frames = 0;
+        float floor = -120.0f;
+        float step = 0.5f;
+    };
+
+    // Writes frames as they come, e.g. as the sink of an analysis, and fills in their count on close()
+    class SpectrogramWriter {
+    private:
+        std::ofstream _file;
+        SpectrogramHeader _header;
+        std::vector<uint8_t> _levels;
+
+    public:
+        // Throws std::runtime_error when the destination cannot be opened
+        SpectrogramWriter(const std::string& destination, const Analyzer& analyzer, int sample_rate, int channels)
+            : _file(destination, std::ios::binary)
+        {
+            if (_file.is_open() == false)
+                throw std::runtime_error("Specified file could not be opened.");
+
+            _header.channels = (uint16_t)std::max(channels, 1);
+            _header.sample_rate = (uint32_t)sample_rate;
+            _header.size = (uint32_t)analyzer.size();
+            _header.hop = (uint32_t)analyzer.hop();
+            _header.bins = (uint32_t)analyzer.bins();
+
+            write_header();
+        }
+
+        const SpectrogramHeader& header() const { return _header; }
+
+        // One frame of channels * bins magnitudes
+        void write(std::span<const float> magnitudes)
+        {
+            // log2 of a float is its exponent plus log2 of its mantissa, looked up here by the top 8 bits of it; within
+            // 0.02 dB of decibels() and several times faster
+            static const std::array<float, 256> mantissa = [] {
+                std::array<float, 256> table;
+                for (size_t i = 0; i < table.size(); i++)
+                    table[i] = (float)std::log2(1 + ((double)i + 0.5) / (double)table.size());
+
+                return table;
+            }();
+
+            constexpr float per_octave = 6.0206f; // 20 * log10(2) dB
+            float scale = 1 / _header.step;
+
+            _levels.resize(magnitudes.size());
+            for (size_t i = 0; i < magnitudes.size(); i++) {
+                uint32_t bits = std::bit_cast<uint32_t>(std::max(magnitudes[i], 1e-12f));
+                float octaves = (float)((int)(bits >> 23) - 127) + mantissa[(bits >> 15) & 0xFF];
+
+                // Rounded to the nearest step, the level is never negative once clamped
+                float level = std::clamp((octaves * per_octave - _header.floor) * scale, 0.0f, 255.0f);
+                _levels[i] = (uint8_t)(level + 0.5f);
+            }
+
+            _file.write((const char*)_levels.data(), (std::streamsize)_levels.size());
+            _header.frames++;
+        }
+
+        void operator()(uint64_t, std::span<const float> magnitudes) { write(magnitudes); }
+
+        // Returns false when anything failed to be written
+        bool close()
+        {
+            _file.seekp(0, std::ios_base::beg);
+            write_header();
+            _file.close();
+
+            return _file.good();
+        }
+
+    private:
+        void write_header()
+        {
+            char bytes[SpectrogramHeader::bytes];
+            char* out = bytes;
+
+            auto put = [&out](const void* field, size_t size) {
+                memcpy(out, field, size);
+                out += size;
+            };
+
+            put("WSPG", 4);
+            put(&_header.version, 2);
+            put(&_header.channels, 2);
+            put(&_header.sample_rate, 4);
+            put(&_header.size, 4);
+            put(&_header.hop, 4);
+            put(&_header.bins, 4);
+            put(&_header.frames, 8);
+            put(&_header.floor, 4);
+            put(&_header.step, 4);
+
+            _file.write(bytes, sizeof(bytes));
+        }
+    };
+
+    // Spectrogram file read back whole, see SpectrogramWriter
+    class Spectrogram {
+    private:
+        SpectrogramHeader _header;
+        std::vector<uint8_t> _levels;
+
+    public:
+        // Throws std::runtime_error when the file cannot be opened or is not a complete spectrogram
+        explicit Spectrogram(const std::string& source)
+        {
+            std::ifstream file(source, std::ios::binary);
+            if (file.is_open() == false)
+                throw std::runtime_error("Specified file could not be opened.");
+
+            char bytes[SpectrogramHeader::bytes];
+            if (file.read(bytes, sizeof(bytes)).good() == false || memcmp(bytes, "WSPG", 4) != 0)
+                throw std::runtime_error("Not a spectrogram file.");
+
+            const char* in = bytes + 4;
+            auto get = [&in](void* field, size_t size) {
+                memcpy(field, in, size);
+                in += size;
+            };
+
+            get(&_header.version, 2);
+            get(&_header.channels, 2);
+            get(&_header.sample_rate, 4);
+            get(&_header.size, 4);
+            get(&_header.hop, 4);
+            get(&_header.bins, 4);
+            get(&_header.frames, 8);
+            get(&_header.floor, 4);
+            get(&_header.step, 4);
+
+            if (_header.version != 1)
+                throw std::runtime_error("Unsupported spectrogram version.");
+
+            // The header has to describe what SpectrogramWriter writes, and the file has to hold exactly its frames,
+            // before anything is allocated; width() is below 2^48, so frames is compared by division, never multiplied
+            if (_header.channels < 1 || _header.size < 1 || _header.bins != _header.size / 2 + 1)
+                throw std::runtime_error("Spectrogram file is corrupt.");
+
+            std::error_code error;
+            uint64_t available = std::filesystem::file_size(source, error) - SpectrogramHeader::bytes;
+            if (error || _header.frames > available / width())
+                throw std::runtime_error("Spectrogram file is truncated.");
+
+            if (_header.frames * width() != available)
+                throw std::runtime_error("Spectrogram file is corrupt.");
+
+            _levels.resize((size_t)_header.frames * width());
+            if (file.read((char*)_levels.data(), (std::streamsize)_levels.size()).good() == false)
+                throw std::runtime_error("Spectrogram file is truncated.");
+        }
+
+        const SpectrogramHeader& header() const { return _header; }
+        uint64_t frames() const { return _header.frames; }
+
+        // Levels of one frame, channel after channel
+        std::span<const uint8_t> frame(uint64_t index) const
+        {
+            return std::span<const uint8_t>(_levels).subspan((size_t)index * width(), width());
+        }
+
+        float decibels(uint64_t frame, int channel, size_t bin) const
+        {
+            return _header.floor + _header.step * (float)this->frame(frame)[(size_t)channel * _header.bins + bin];
+        }
+
+    private:
+        size_t width() const { return (size_t)_header.channels * _header.bins; }
+    };
+} // namespace stft
+} // namespace wav
+
+#endif
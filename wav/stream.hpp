@@ -0,0 +1,399 @@
+#ifndef _WAV_STREAM_H
+#define _WAV_STREAM_H
+
+#include "../waveform.hpp"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace wav {
+
+// Bounded-memory processing of files larger than RAM
+// The data chunk is read in fixed-size blocks, each block runs through the stages in the order they were added and
+// is written out straight away. Only one block (plus each convolution's tail and each dynamics stage's lookahead)
+// is ever held in memory
+// Normalization needs the peak of the signal entering it, so it costs one extra pass over the file (running the
+// stages in front of it) before the final one
+class Stream {
+public:
+    static constexpr size_t default_block = size_t(1) << 16;
+
+private:
+    class Stage {
+    public:
+        virtual ~Stage() = default;
+
+        // Back to the initial state, before a new pass over the file
+        virtual void reset() = 0;
+        virtual void process(std::span<short> block, const Parallelism& parallelism) = 0;
+
+        // Frames by which the output lags the input, see pass()
+        virtual size_t latency() const { return 0; }
+    };
+
+    template <typename Functor>
+    class FilterStage final : public Stage {
+    private:
+        Functor prototype, active;
+
+    public:
+        FilterStage(Functor action)
+            : prototype(action)
+            , active(action)
+        {
+        }
+
+        void reset() override { active = prototype; }
+        void process(std::span<short> block, const Parallelism& parallelism) override
+        {
+            apply_filter(active, block, parallelism);
+        }
+    };
+
+    class ConvolutionStage final : public Stage {
+    private:
+        ConvolutionState state;
+
+    public:
+        ConvolutionStage(std::shared_ptr<const Convolver> convolver, int channels)
+            : state(std::move(convolver), channels)
+        {
+        }
+
+        void reset() override { state.reset(); }
+        void process(std::span<short> block, const Parallelism& parallelism) override { state.process(block, parallelism); }
+    };
+
+    class DynamicsStage final : public Stage {
+    private:
+        dynamics::Processor processor;
+
+    public:
+        DynamicsStage(const dynamics::Processor& processor)
+            : processor(processor)
+        {
+        }
+
+        void reset() override { processor.reset(); }
+        void process(std::span<short> block, const Parallelism&) override { processor.process(block); }
+        size_t latency() const override { return processor.latency(); }
+    };
+
+    class NormalizeStage final : public Stage {
+    public:
+        // Set from the peak scan, before the final pass
+        float factor = 1.0f;
+
+        void reset() override { }
+        void process(std::span<short> block, const Parallelism& parallelism) override
+        {
+            demo::filters::Gain<float, short> gain(factor);
+            apply_filter(gain, block, parallelism);
+        }
+    };
+
+    std::string _source;
+    WAVHeader _header;
+    size_t _data_offset = 0;
+    size_t _data_bytes = 0;
+    size_t _block;
+
+    Parallelism _parallelism;
+    std::vector<std::unique_ptr<Stage>> _stages;
+
+    // Applied to the output of the last stage, as the blocks are written
+    std::shared_ptr<const Resampler> _resampler;
+
+public:
+    explicit Stream(const std::string& source, size_t block = default_block)
+        : _source(source)
+        , _block(std::max<size_t>(block, 1))
+    {
+        std::ifstream file(source, std::ios::binary);
+        if (file.is_open() == false)
+            throw std::runtime_error("Specified file could not be opened.");
+
+        _data_offset = read_header(file, _header);
+        if (holds<format::S16>(_header) == false)
+            throw std::runtime_error("Only 16-bit PCM files can be streamed.");
+
+        file.seekg(0, std::ios_base::end);
+        std::streamoff file_size = file.tellg();
+
+        // Same clamping as Waveform: never trust the declared size beyond the end of the file
+        size_t available = file_size > (std::streamoff)_data_offset ? static_cast<size_t>(file_size) - _data_offset : 0;
+        size_t declared = static_cast<uint32_t>(_header.subchunk2_size);
+        _data_bytes = std::min(declared, available);
+        _data_bytes -= _data_bytes % sizeof(short);
+
+        // Blocks hold whole frames, so per-channel state (see biquad()) lines up from one block to the next
+        size_t frame = std::max<size_t>(_header.num_channels, 1);
+        _block = std::max(_block - _block % frame, frame);
+    }
+
+    const WAVHeader& header() const { return _header; }
+    size_t block_size() const { return _block; }
+
+    // Frames in the data chunk of the source
+    size_t frames() const { return _data_bytes / sizeof(short) / std::max<size_t>(_header.num_channels, 1); }
+
+    // Workers used within each block, see Waveform::parallel
+    Stream& parallel(int threads, size_t grain = Parallelism::default_grain)
+    {
+        _parallelism = Parallelism { threads, grain };
+        return *this;
+    }
+
+    template <typename Functor>
+    Stream& filter(Functor action)
+    {
+        _stages.push_back(std::make_unique<FilterStage<Functor>>(action));
+        return *this;
+    }
+
+    // Every channel keeps its filter state from one block to the next, see iir::Filter
+    Stream& biquad(const iir::Cascade& cascade, iir::Precision precision = iir::Precision::Float)
+    {
+        int channels = std::max<int>(_header.num_channels, 1);
+
+        if (precision == iir::Precision::Double)
+            return filter(iir::Filter<double>(cascade, _header.sample_rate, channels));
+
+        return filter(iir::Filter<float>(cascade, _header.sample_rate, channels));
+    }
+
+    // Lookahead limiter, compressor or gate, see wav/dynamics.hpp; its delay is taken out of the output
+    Stream& dynamics(const dynamics::Settings& settings)
+    {
+        int channels = std::max<int>(_header.num_channels, 1);
+        _stages.push_back(std::make_unique<DynamicsStage>(dynamics::Processor(settings, _header.sample_rate, channels)));
+        return *this;
+    }
+
+    // Every channel is convolved on its own, as by Waveform::convolute
+    Stream& convolute(const std::vector<float>& kernel) { return convolute(Convolver::get(kernel)); }
+
+    Stream& convolute(std::shared_ptr<const Convolver> convolver)
+    {
+        _stages.push_back(std::make_unique<ConvolutionStage>(std::move(convolver), std::max<int>(_header.num_channels, 1)));
+        return *this;
+    }
+
+    // Writes the result at `rate` frames per second, resampled after every stage (see wav/resample.hpp)
+    Stream& resample(int rate)
+    {
+        _resampler = rate == _header.sample_rate ? nullptr : Resampler::get(_header.sample_rate, rate);
+        return *this;
+    }
+
+    Stream& normalize()
+    {
+        _stages.push_back(std::make_unique<NormalizeStage>());
+        return *this;
+    }
+
+    int save(const std::string& destination = "out.wav", bool verbose = true)
+    {
+        std::error_code error;
+        if (std::filesystem::equivalent(_source, destination, error)) {
+            std::cerr << "Error: Cannot stream " << _source << " onto itself." << std::endl;
+            return FAILURE;
+        }
+
+        std::ofstream file(destination, std::ios::binary);
+        if (file.is_open() == false) {
+            std::cerr << "Error: Could not open " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        WAVHeader output = _header;
+        size_t bytes = _data_bytes;
+
+        if (_resampler != nullptr) {
+            int channels = std::max<int>(_header.num_channels, 1);
+            output.sample_rate = _resampler->to();
+            output.byte_rate = output.sample_rate * output.block_align;
+            bytes = (size_t)_resampler->frames(_data_bytes / sizeof(short) / channels) * channels * sizeof(short);
+        }
+
+        auto header = encode_header(output, bytes);
+        file.write(header.data(), header.size());
+
+        int status = run([&file](std::span<const short> block) {
+            file.write((const char*)block.data(), block.size_bytes());
+            return file.good();
+        });
+
+        if (status || file.good() == false) {
+            std::cerr << "Error: Could not save information data to " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        file.close();
+        if (verbose)
+            std::cout << "Sucessfully saved to " << destination << "." << std::endl;
+
+        return SUCCESS;
+    }
+
+    // Short-time Fourier analysis of the result, as save() would write it (see wav/stft.hpp)
+    // sink(frame, magnitudes) is called for every frame in order, with channels * bins() magnitudes
+    template <typename Sink>
+    int spectrum(const stft::Analyzer& analyzer, Sink sink)
+    {
+        stft::State state(analyzer, std::max<int>(_header.num_channels, 1));
+
+        int status = run([&](std::span<const short> block) {
+            state.process(block, sink, _parallelism);
+            return true;
+        });
+
+        if (status)
+            return FAILURE;
+
+        state.finish(sink, _parallelism);
+        return SUCCESS;
+    }
+
+    // Writes a spectrogram file of the result (see stft::SpectrogramWriter), in bounded memory
+    int spectrogram(const std::string& destination, const stft::Settings& settings = {}, bool verbose = true)
+    {
+        stft::Analyzer analyzer(settings);
+        int rate = _resampler != nullptr ? _resampler->to() : _header.sample_rate;
+        std::optional<stft::SpectrogramWriter> writer;
+
+        try {
+            writer.emplace(destination, analyzer, rate, std::max<int>(_header.num_channels, 1));
+        } catch (const std::runtime_error&) {
+            std::cerr << "Error: Could not open " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        int status = spectrum(analyzer, [&writer](uint64_t, std::span<const float> magnitudes) {
+            writer->write(magnitudes);
+        });
+
+        if (writer->close() == false || status) {
+            std::cerr << "Error: Could not save spectrogram to " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        if (verbose)
+            std::cout << "Sucessfully saved to " << destination << "." << std::endl;
+
+        return SUCCESS;
+    }
+
+private:
+    // Hands the result to `sink` block by block, which returns false to abort: runs the peak scans, then the final
+    // pass through every stage and the resampler
+    template <typename Sink>
+    int run(Sink sink)
+    {
+        // Peak scans, one per normalization, each running the stages in front of it
+        for (size_t i = 0; i < _stages.size(); i++) {
+            auto* normalization = dynamic_cast<NormalizeStage*>(_stages[i].get());
+            if (normalization == nullptr)
+                continue;
+
+            SignalStats stats;
+            int status = pass(i, [this, &stats](std::span<const short> block) {
+                stats.merge(summarize(block, _parallelism));
+                return true;
+            });
+
+            if (status)
+                return FAILURE;
+
+            normalization->factor = normalization_factor(stats.peak());
+        }
+
+        if (_resampler == nullptr)
+            return pass(_stages.size(), sink);
+
+        ResampleState resampling(_resampler, std::max<int>(_header.num_channels, 1));
+        std::vector<short> resampled;
+
+        int status = pass(_stages.size(), [&](std::span<const short> block) {
+            resampled.clear();
+            resampling.process(block, resampled);
+            return sink(std::span<const short>(resampled));
+        });
+
+        if (status)
+            return FAILURE;
+
+        // The last few frames depend on the silence after the end
+        resampled.clear();
+        resampling.finish(resampled);
+        return sink(std::span<const short>(resampled)) ? SUCCESS : FAILURE;
+    }
+
+    // Reads the data chunk block by block, runs every block through the first `count` stages and hands it to
+    // `sink`, which returns false to abort
+    // Stages with a latency delay what follows them; the frames that amounts to are dropped from the front of the
+    // output, and made up at the end by running silence through the stages
+    template <typename Sink>
+    int pass(size_t count, Sink sink)
+    {
+        std::ifstream file(_source, std::ios::binary);
+        if (file.is_open() == false) {
+            std::cerr << "Error: Could not open " << _source << "." << std::endl;
+            return FAILURE;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            _stages[i]->reset();
+
+        // Seek to the beginning of the (actual) information sector
+        file.seekg((std::streamoff)_data_offset, std::ios_base::beg);
+
+        size_t delay = 0;
+        for (size_t i = 0; i < count; i++)
+            delay += _stages[i]->latency() * std::max<size_t>(_header.num_channels, 1);
+
+        // Recycled by the thread's pool across passes and streams
+        std::pmr::vector<short> buffer(_block, &memory::local());
+        size_t remaining = _data_bytes / sizeof(short);
+        size_t silence = delay;
+
+        while (remaining > 0 || silence > 0) {
+            size_t length;
+            if (remaining > 0) {
+                length = std::min(_block, remaining);
+                file.read((char*)buffer.data(), length * sizeof(short));
+
+                if ((size_t)file.gcount() != length * sizeof(short)) {
+                    std::cerr << "Error: Unexpected end of " << _source << "." << std::endl;
+                    return FAILURE;
+                }
+
+                remaining -= length;
+            } else {
+                length = std::min(_block, silence);
+                std::fill(buffer.begin(), buffer.begin() + (ptrdiff_t)length, (short)0);
+                silence -= length;
+            }
+
+            std::span<short> block(buffer.data(), length);
+            for (size_t i = 0; i < count; i++)
+                _stages[i]->process(block, _parallelism);
+
+            size_t skip = std::min(delay, block.size());
+            delay -= skip;
+
+            if (skip < block.size() && sink(std::span<const short>(block.subspan(skip))) == false)
+                return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+};
+
+} // namespace wav
+
+#endif
@@ -1,8 +1,28 @@
 #ifndef _WAV_HEADER_H
 #define _WAV_HEADER_H
 
-#include <Windows.h>
+#include "wav/chain.hpp"
+#include "wav/convolution.hpp"
+#include "wav/copy_on_write.hpp"
+#include "wav/dynamics.hpp"
+#include "wav/format.hpp"
+#include "wav/iir.hpp"
+#include "wav/interleave.hpp"
+#include "wav/mapped_file.hpp"
+#include "wav/memory.hpp"
+#include "wav/overview.hpp"
+#include "wav/parallel.hpp"
+#include "wav/resample.hpp"
+#include "wav/riff.hpp"
+#include "wav/signal_stats.hpp"
+#include "wav/simd.hpp"
+#include "wav/stats.hpp"
+#include "wav/stft.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <concepts>
+#include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iomanip>
@@ -10,7 +30,13 @@
 #include <limits>
 #include <math.h>
 #include <memory.h>
+#include <memory>
+#include <memory_resource>
 #include <omp.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 /* DEMO SHOWCASE */
@@ -43,6 +69,17 @@ namespace filters {
 
         // Perform filtering on the given sample when called as a functor
         SampleType operator()(SampleType& sample) { }
+
+        // Optionally, filter a whole block of samples at once (e.g. with SIMD); Waveform::filter prefers it
+        // over the per-sample functor when it is present
+        // void process(std::span<SampleType> samples) { }
+
+        // Filters carrying state from one sample to the next must not be split across threads, declare them as
+        // static constexpr bool sequential = true;
+
+        // Per-sample filters that preserve the order of samples (1) or reverse it (-1) can say so, letting
+        // Waveform keep its cached extrema instead of rescanning
+        // int monotonic() const { return 1; }
     };
 
     template <typename EffectValType, typename SampleType = EffectValType>
@@ -62,6 +99,24 @@ namespace filters {
 
             return std::abs(sample) > threshold ? sgn * threshold : sample;
         }
+
+        void process(std::span<SampleType> samples)
+        {
+            if constexpr (std::is_same_v<SampleType, short>) {
+                if (threshold >= 0) {
+                    // Nothing reaches the threshold otherwise
+                    if (threshold < 32768)
+                        wav::simd::clip(samples.data(), samples.size(), (short)-threshold, (short)threshold);
+                    return;
+                }
+            }
+
+            for (SampleType& sample : samples)
+                sample = (*this)(sample);
+        }
+
+        // A negative threshold flips samples across zero
+        int monotonic() const { return threshold >= 0 ? 1 : 0; }
     };
 
     template <typename EffectValType, typename SampleType = EffectValType>
@@ -69,22 +124,45 @@ namespace filters {
     private:
         float factor;
 
+        // Factors below unity are applied in Q15 fixed point (16-bit samples only), 0 when not applicable
+        short q15;
+
     public:
         Gain(float value)
             : factor(value)
+            , q15(wav::simd::q15_factor(value))
         {
         }
 
+        // Results are saturated to the sample range, so an overflowing sample is clipped rather than wrapped
         SampleType operator()(SampleType sample)
         {
-            EffectValType attenuated;
-
-            // Take care of overflow!
-            if (std::abs(sample) >= std::numeric_limits<SampleType>::max() - 1 || std::numeric_limits<SampleType>::max() / factor < std::abs(sample))
-                return sample;
+            if constexpr (std::is_same_v<SampleType, short>) {
+                return q15 != 0 ? wav::simd::scale_q15(sample, q15) : wav::simd::scale_float(sample, factor);
+            } else if constexpr (std::is_integral_v<SampleType>) {
+                double value = std::clamp((double)sample * factor, (double)std::numeric_limits<SampleType>::min(),
+                    (double)std::numeric_limits<SampleType>::max());
+
+                return (SampleType)value;
+            } else {
+                return (SampleType)(sample * factor);
+            }
+        }
 
-            return (SampleType)(sample * factor);
+        void process(std::span<SampleType> samples)
+        {
+            if constexpr (std::is_same_v<SampleType, short>) {
+                if (q15 != 0)
+                    wav::simd::scale_q15(samples.data(), samples.size(), q15);
+                else
+                    wav::simd::scale_float(samples.data(), samples.size(), factor);
+            } else {
+                for (SampleType& sample : samples)
+                    sample = (*this)(sample);
+            }
         }
+
+        int monotonic() const { return factor >= 0 ? 1 : (factor < 0 ? -1 : 0); }
     };
 
     template <typename EffectValType = float, typename SampleType = EffectValType>
@@ -93,36 +171,97 @@ namespace filters {
         // Absolute amplitudal threshold : [0, 1]
         EffectValType threshold;
 
+        // Smallest absolute sample value that gets pulsified, so the amplitude test needs no division
+        long long bound;
+
     public:
         Pulsify(EffectValType value)
             : threshold(std::abs(value))
+            , bound(find_bound())
         {
         }
+
         SampleType operator()(SampleType& sample)
         {
-            // abs(sample_intensity) / maximum_intensity = abs_av
-            // sample_intensity / maximum_intensity = amplitude
-            float amplitude = (float)sample / (float)std::numeric_limits<SampleType>::max();
-
-            if (std::abs(amplitude) < threshold)
-                return sample;
+            if constexpr (std::is_integral_v<SampleType>) {
+                if (sample > -bound && sample < bound)
+                    return sample;
+            } else {
+                if (pulsified(sample) == false)
+                    return sample;
+            }
 
             return (sample < 0 ? std::numeric_limits<SampleType>::min()
                                : std::numeric_limits<SampleType>::max());
         }
+
+        void process(std::span<SampleType> samples)
+        {
+            if constexpr (std::is_same_v<SampleType, short>) {
+                wav::simd::pulse(samples.data(), samples.size(), (int)bound);
+            } else {
+                for (SampleType& sample : samples)
+                    sample = (*this)(sample);
+            }
+        }
+
+        // Negative samples only ever move down, positive ones up
+        int monotonic() const { return 1; }
+
+    private:
+        // abs(sample_intensity) / maximum_intensity = abs_av
+        // sample_intensity / maximum_intensity = amplitude
+        template <typename ValueType>
+        bool pulsified(ValueType value) const
+        {
+            float amplitude = (float)value / (float)std::numeric_limits<SampleType>::max();
+            return !(std::abs(amplitude) < threshold);
+        }
+
+        // The amplitude test is monotonic in the magnitude, so the cut-off can be searched for once
+        // Returns one past the largest magnitude when no sample reaches the threshold
+        long long find_bound() const
+        {
+            if constexpr (std::is_integral_v<SampleType>) {
+                long long low = 0;
+                long long high = std::max(-(long long)std::numeric_limits<SampleType>::min(),
+                                     (long long)std::numeric_limits<SampleType>::max())
+                    + 1;
+
+                if (pulsified(high - 1) == false)
+                    return high;
+
+                while (low < high) {
+                    long long middle = low + (high - low) / 2;
+
+                    if (pulsified(middle))
+                        high = middle;
+                    else
+                        low = middle + 1;
+                }
+
+                return low;
+            } else {
+                return 0;
+            }
+        }
     };
 
     template <typename EffectValType = float, typename SampleType = EffectValType>
     class Normalize final {
     private:
-        float factor;
+        Gain<float, SampleType> gain;
 
     public:
         Normalize(float value)
-            : factor(value)
+            : gain(value)
         {
         }
-        SampleType operator()(SampleType sample) { return (SampleType)(sample * factor); }
+        SampleType operator()(SampleType sample) { return gain(sample); }
+
+        void process(std::span<SampleType> samples) { gain.process(samples); }
+
+        int monotonic() const { return gain.monotonic(); }
     };
 } // namespace filters
 } // namespace demo
@@ -139,8 +278,8 @@ Some notes:
         A Wave datastream can contain more than two subchunks (in a non-restricting order), each containing their
 own, unique identifiers and sizes
 
-        * We are assuming that the WAVE file is 16-bit per-channel (i.e. 2 bytes, so we can use int16_t, a.k.a.
-'short')
+        * wav::Waveform assumes that the WAVE file is 16-bit per-channel (i.e. 2 bytes, so we can use int16_t, a.k.a.
+'short'), other sample formats are handled by their own BasicWaveform (see wav/format.hpp)
         * If the WAVE file is encoded in 24-bit (signed), we must use 3-byte-minimum storage for up to 2^24
 different values
         * Maximum dynamic range of a 16-bit PCM encoded WAVE is 96dB (144dB for 24-bit)
@@ -174,115 +313,767 @@ const char SUCCESS = 0;
 
 // clang-format on
 
-class Waveform {
+// Buffered: the data chunk is read into memory with a single bulk read
+// Mapped: the data chunk is exposed through a read-only memory mapping, and only copied on first modification
+enum class IOMode {
+    Buffered,
+    Mapped
+};
+
+// Interleaved: samples in file order, L R L R ...
+// Planar: one contiguous, cache-line aligned buffer per channel, so per-channel processing is unit-stride
+enum class Layout {
+    Interleaved,
+    Planar
+};
+
+// Fills the header from the 'fmt ' and 'data' chunks, wherever they sit in the file, and returns the offset of the
+// first sample. Other chunks (LIST, fact, bext, ...) are skipped without being read
+inline size_t read_header(std::istream& file, WAVHeader& header, riff::Index* chunks = nullptr)
+{
+    riff::Index index = riff::scan(file);
+
+    const riff::Chunk* format = index.find("fmt ");
+    const riff::Chunk* data = index.find("data");
+    if (memcmp(index.form.data(), "WAVE", 4) != 0 || format == nullptr || format->size < 16 || data == nullptr)
+        throw std::runtime_error("Specified file is not a valid WAVE file.");
+
+    header.chunk_id = index.id;
+    header.chunk_size = (int)index.size;
+    header.format = index.form;
+
+    // Only the 16 canonical bytes are kept, and written back on save
+    char fmt[40] = {};
+    file.seekg((std::streamoff)format->offset, std::ios_base::beg);
+    file.read(fmt, std::min<uint32_t>(format->size, sizeof(fmt)));
+
+    header.subchunk1_id = format->id;
+    header.subchunk1_size = 16;
+    memcpy(&header.audio_format, fmt, 2);
+    memcpy(&header.num_channels, fmt + 2, 2);
+    memcpy(&header.sample_rate, fmt + 4, 4);
+    memcpy(&header.byte_rate, fmt + 8, 4);
+    memcpy(&header.block_align, fmt + 12, 2);
+    memcpy(&header.bits_per_sample, fmt + 14, 2);
+
+    // WAVE_FORMAT_EXTENSIBLE carries the actual format tag in the first two bytes of its sub-format GUID
+    if ((unsigned short)header.audio_format == 0xFFFE && format->size >= 40)
+        memcpy(&header.audio_format, fmt + 24, 2);
+
+    header.subchunk2_id = data->id;
+    header.subchunk2_size = (int)data->size;
+
+    file.clear();
+    size_t offset = (size_t)data->offset;
+    if (chunks != nullptr)
+        *chunks = std::move(index);
+
+    return offset;
+}
+
+// Header-only view of a file: format, chunk layout and where the samples start, without touching the samples
+struct Probe {
+    WAVHeader header;
+    riff::Index chunks;
+    size_t data_offset = 0;
+
+    // Size of the data chunk, as present in the file
+    size_t data_bytes() const { return (uint32_t)header.subchunk2_size; }
+
+    // Playback length in seconds
+    double duration() const
+    {
+        double frame_bytes = (header.bits_per_sample / 8) * (double)header.num_channels;
+        if (frame_bytes <= 0 || header.sample_rate <= 0)
+            return 0.0;
+
+        return (double)data_bytes() / frame_bytes / (double)header.sample_rate;
+    }
+};
+
+// Reads only the chunk headers and the 'fmt ' payload, so the cost is the same for a 1 KB or a 1 GB file
+inline Probe probe(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (file.is_open() == false)
+        throw std::runtime_error("Specified file could not be opened.");
+
+    Probe result;
+    result.data_offset = read_header(file, result.header, &result.chunks);
+
+    return result;
+}
+
+inline void print_header(const WAVHeader& header, std::ostream& os = std::cout)
+{
+    auto to_string = [](const std::array<char, 4>& arr) {
+        std::string ret = "";
+        for (const auto& elem : arr)
+            ret += elem;
+
+        return std::string(ret);
+    };
+
+    auto chunk_id = to_string(header.chunk_id);
+    auto format = to_string(header.format);
+    auto subchunk1_id = to_string(header.subchunk1_id);
+    auto subchunk2_id = to_string(header.subchunk2_id);
+
+    os << std::setw(24) << "- RIFF chunk descriptor -" << std::endl;
+    os << std::setw(18) << "chunk_id: " << chunk_id << std::endl;
+    os << std::setw(18) << "chunk_size: " << header.chunk_size << std::endl;
+    os << std::setw(18) << "format: " << format << std::endl;
+
+    os << std::setw(24) << "\n- FMT sub-chunk - " << std::endl;
+    os << std::setw(18) << "subchunk1_id: " << subchunk1_id << std::endl;
+    os << std::setw(18) << "audio_format: " << header.audio_format << std::endl;
+    os << std::setw(18) << "num_channels: " << header.num_channels << std::endl;
+    os << std::setw(18) << "sample_rate: " << header.sample_rate << std::endl;
+    os << std::setw(18) << "byte_rate: " << header.byte_rate << std::endl;
+    os << std::setw(18) << "block_align: " << header.block_align << std::endl;
+    os << std::setw(18) << "bits_per_sample: " << header.bits_per_sample << std::endl;
+
+    os << std::setw(24) << "\n- DATA sub-chunk - " << std::endl;
+    os << std::setw(18) << "subchunk2_id: " << subchunk2_id << std::endl;
+    os << std::setw(18) << "subchunk2_size: " << header.subchunk2_size << std::endl;
+
+    // length = (total_sample_bytes / bytes_per_frame) / sample_rate
+    Probe probe;
+    probe.header = header;
+    os << std::setw(18) << "\nLength: " << probe.duration() << "s" << std::endl;
+}
+
+// Serializes the canonical 44-byte header, with the size fields describing `data_size` bytes of samples
+inline std::array<char, 44> encode_header(const WAVHeader& header, size_t data_bytes)
+{
+    std::array<char, 44> bytes;
+    char* out = bytes.data();
+
+    int data_size = static_cast<int>(data_bytes);
+    int chunk_size = 36 + data_size;
+
+    auto put = [&out](const void* field, size_t size) {
+        memcpy(out, field, size);
+        out += size;
+    };
+
+    // RIFF chunk descriptor
+    put(header.chunk_id.data(), 4);
+    put(&chunk_size, 4);
+    put(header.format.data(), 4);
+
+    // 'fmt' sub-chunk
+    put(header.subchunk1_id.data(), 4);
+    put(&header.subchunk1_size, 4);
+    put(&header.audio_format, 2);
+    put(&header.num_channels, 2);
+    put(&header.sample_rate, 4);
+    put(&header.byte_rate, 4);
+    put(&header.block_align, 2);
+    put(&header.bits_per_sample, 2);
+
+    // 'data' sub-chunk
+    put(header.subchunk2_id.data(), 4);
+    put(&data_size, 4);
+
+    return bytes;
+}
+
+// Canonical header for `channels` interleaved channels of the given sample format, describing no samples yet
+template <typename Format>
+WAVHeader make_header(int sample_rate, int channels = 1)
+{
+    short block_align = (short)(channels * format::stored_bytes<Format>);
+
+    return { { 'R', 'I', 'F', 'F' }, 36, { 'W', 'A', 'V', 'E' }, { 'f', 'm', 't', ' ' }, 16, Format::tag,
+        (short)channels, sample_rate, sample_rate * block_align, block_align, (short)Format::bits,
+        { 'd', 'a', 't', 'a' }, 0 };
+}
+
+// Peak, extrema, DC offset, RMS and clip count of a range in one pass, split across the configured workers
+inline SignalStats summarize(std::span<const short> samples, const Parallelism& parallelism = {})
+{
+    std::vector<SignalStats> partial(std::max<size_t>(parallelism.tasks(samples.size()), 1));
+    parallel_for(samples.size(), parallelism, [&](size_t task, size_t begin, size_t end) {
+        simd::summarize(samples.data() + begin, end - begin, partial[task]);
+    });
+
+    SignalStats stats;
+    for (const SignalStats& part : partial)
+        stats.merge(part);
+
+    return stats;
+}
+
+// Gain that brings a signal peaking at `peak` (either polarity) to full scale, silence is left as it is
+inline float normalization_factor(int peak)
+{
+    if (peak == 0)
+        return 1.0f;
+
+    float amplitude = (float)std::abs(peak) / (INT16_MAX - 1);
+    return 1 / amplitude;
+}
+
+// Applies a filter to a block of samples, through its block kernel when it has one
+// Unless the filter is sequential, the block is split across the configured workers, each task running on its own
+// copy of the filter
+template <typename Functor, typename SampleType>
+void apply_filter(Functor& action, std::span<SampleType> block, const Parallelism& parallelism = {})
+{
+    auto apply = [](Functor& action, std::span<SampleType> block) {
+        if constexpr (BlockFilter<Functor, SampleType>)
+            action.process(block);
+        else
+            for (SampleType& sample : block)
+                sample = action(sample);
+    };
+
+    if constexpr (SequentialFilter<Functor>) {
+        apply(action, block);
+    } else {
+        parallel_for(block.size(), parallelism, [&](size_t, size_t begin, size_t end) {
+            Functor local = action;
+            apply(local, block.subspan(begin, end - begin));
+        });
+    }
+}
+
+// Whether a header describes samples of the given format
+template <typename Format>
+bool holds(const WAVHeader& header)
+{
+    return header.audio_format == Format::tag && header.bits_per_sample == Format::bits;
+}
+
+// Shared by a waveform and its writable views, which flag here that they modified its samples
+class ViewLink {
+private:
+    std::atomic<bool> _modified { false };
+
+public:
+    void touch() { _modified.store(true, std::memory_order_release); }
+
+    // Whether the samples were modified since the last call
+    bool modified() { return _modified.exchange(false, std::memory_order_acq_rel); }
+};
+
+// Non-owning window onto consecutive frames of interleaved samples, e.g. one second of a waveform
+// Cheap to make and to pass by value. Filters run on the viewed samples in place, so a view of SampleType (rather
+// than const SampleType) writes straight into the waveform it was taken from; see BasicWaveform::view
+template <typename SampleType>
+class BasicView {
+private:
+    std::span<SampleType> _samples;
+    int _channels = 1;
+    int _sample_rate = 0;
+    Parallelism _parallelism;
+
+    // Tells the owning waveform about writes, if any
+    std::shared_ptr<ViewLink> _link;
+
+public:
+    BasicView() = default;
+
+    BasicView(std::span<SampleType> samples, int channels, int sample_rate, const Parallelism& parallelism = {},
+        std::shared_ptr<ViewLink> link = nullptr)
+        : _samples(samples)
+        , _channels(std::max(channels, 1))
+        , _sample_rate(sample_rate)
+        , _parallelism(parallelism)
+        , _link(std::move(link))
+    {
+    }
+
+    // Read-only views of writable ones
+    operator BasicView<const SampleType>() const
+        requires(std::is_const_v<SampleType> == false)
+    {
+        return BasicView<const SampleType>(_samples, _channels, _sample_rate, _parallelism);
+    }
+
+    // Mutable samples of a writable view count as modified
+    std::span<SampleType> samples() const
+    {
+        if constexpr (std::is_const_v<SampleType> == false)
+            if (_link)
+                _link->touch();
+
+        return _samples;
+    }
+
+    int channels() const { return _channels; }
+    int sample_rate() const { return _sample_rate; }
+
+    size_t num_samples() const { return _samples.size(); }
+    size_t num_frames() const { return _samples.size() / _channels; }
+    double duration() const { return _sample_rate > 0 ? (double)num_frames() / _sample_rate : 0.0; }
+
+    // Frames [first, first + count) of this view, clamped to it
+    BasicView frames(size_t first, size_t count = std::dynamic_extent) const
+    {
+        first = std::min(first, num_frames());
+        count = std::min(count, num_frames() - first);
+
+        return BasicView(_samples.subspan(first * _channels, count * _channels), _channels, _sample_rate, _parallelism, _link);
+    }
+
+    // Frames from `from` up to `to` seconds into this view, rounded down to whole frames
+    BasicView seconds(double from, double to) const
+    {
+        auto frame = [this](double seconds) {
+            return (size_t)std::clamp(seconds * _sample_rate, 0.0, (double)num_frames());
+        };
+
+        size_t first = frame(from), last = frame(to);
+        return frames(first, last > first ? last - first : 0);
+    }
+
+    // Same rules as BasicWaveform::filter on interleaved samples
+    template <typename Functor>
+    BasicView& filter(Functor action)
+        requires(std::is_const_v<SampleType> == false)
+    {
+        apply_filter(action, _samples, _parallelism);
+        if (_link)
+            _link->touch();
+
+        return *this;
+    }
+
+    SignalStats analyze() const
+        requires std::same_as<std::remove_const_t<SampleType>, short>
+    {
+        return summarize(std::span<const short>(_samples), _parallelism);
+    }
+};
+
+// Waveform of one sample format, with Channels channels (0: as many as the file has)
+// Samples are kept the way the format stores them (see wav/format.hpp), so every loop over them is specialized for
+// the sample type at compile time. Loading a file of another format or channel count throws
+// Convolution, analysis and normalization work on 16-bit samples
+template <typename Format, int Channels = 0>
+class BasicWaveform {
+public:
+    using format_type = Format;
+    using sample_type = typename Format::sample_type;
+
+    static constexpr int channel_count = Channels;
+    static constexpr bool is_s16 = std::is_same_v<Format, format::S16>;
+
+    // Sample buffers come from the waveform's memory resource, see memory()
+    using Samples = std::pmr::vector<sample_type>;
+
 private:
     WAVHeader _header;
-    std::vector<short> _data;
+
+    // Owned samples, shared with copies of this waveform until either of them modifies the samples
+    CopyOnWrite<Samples> _data;
+
+    // Offset of the first sample in the source file
+    size_t _data_offset = 44;
+
+    // Backing storage of a mapped waveform, _data stays empty until the samples are modified
+    std::shared_ptr<const MappedFile> _mapping;
+    std::span<const sample_type> _view;
+
+    // In planar layout the samples live in _planes, shared between copies like _data; _data and the mapping are empty
+    Layout _layout = Layout::Interleaved;
+    CopyOnWrite<std::pmr::vector<Samples>> _planes;
+
+    Parallelism _parallelism;
+    std::pmr::memory_resource* _resource = memory::aligned();
+
+    // Result of the last analyze(), dropped whenever the samples change
+    // Monotonic filters carry the extrema over, the remaining fields then need a rescan
+    mutable std::optional<SignalStats> _analysis;
+    mutable bool _extrema_only = false;
+
+#ifdef WAV_STATS
+    Stats _stats;
+#endif
 
 public:
-    Waveform() = default;
+    BasicWaveform() = default;
 
-    Waveform(std::ifstream& file)
+    BasicWaveform(std::ifstream& file)
     {
         init_header(file);
         init_data(file);
     }
 
-    Waveform(const std::string& filename)
+    BasicWaveform(const std::string& filename, IOMode mode = IOMode::Buffered, Layout layout = Layout::Interleaved)
     {
-        std::ifstream file(filename, std::ios::binary);
-
-        if (file.is_open() == false)
+        if (load(filename, mode, layout))
             throw std::runtime_error("Specified file could not be opened.");
+    }
 
-        init_header(file);
-        init_data(file);
+    // Copies share the samples (or the mapping) of the original until one of them is modified, which then gets its
+    // own; variants rendered from one source cost one buffer each, and copies that are only read cost nothing
+    BasicWaveform(const BasicWaveform&) = default;
+    BasicWaveform(BasicWaveform&&) = default;
+    BasicWaveform& operator=(const BasicWaveform&) = default;
+    BasicWaveform& operator=(BasicWaveform&&) = default;
+
+    // Mutable access to the interleaved samples detaches a mapped waveform from its file and a copy from the
+    // samples it shares, switches a planar one back to interleaved, and forgets the cached statistics
+    // The reference is stable until the waveform is copied, after which it would write to both
+    auto& data()
+    {
+        _analysis.reset();
+        interleaved();
+        materialize();
+        if (_data.has_value() == false)
+            _data.reset(Samples(_resource));
 
-        file.close();
+        return _data.write();
     }
+    // Same as samples()
+    std::span<const sample_type> data() const { return samples(); }
 
-    Waveform& operator=(const Waveform& rhs)
+    // Read-only, copy-free access to the interleaved samples, regardless of how they were loaded
+    // Not available in planar layout, use channel() there
+    std::span<const sample_type> samples() const
     {
-        _header = rhs._header;
-        _data = rhs._data;
+        if (_layout == Layout::Planar)
+            throw std::logic_error("Samples are stored planar, access them by channel.");
+
+        return is_mapped() ? _view : std::span<const sample_type>(*_data);
+    }
+    bool is_mapped() const { return _mapping != nullptr; }
+
+    // Whether the samples are still shared with a copy (or a copy of a copy) of this waveform
+    bool is_shared() const { return _layout == Layout::Planar ? _planes.shared() : _data.shared(); }
+
+    // Frames [first, first + count) of the interleaved samples, clamped to the waveform; narrow it down further by
+    // time with seconds(), e.g. view().seconds(1.0, 2.5)
+    // A writable view first detaches the samples like data(), and the cached statistics are dropped whenever a view
+    // modifies them. While one is alive, copies of the waveform get samples of their own rather than sharing the ones
+    // it writes to. It stays valid until the waveform is modified other than through views, reloaded or switched to
+    // planar layout
+    BasicView<sample_type> view(size_t first = 0, size_t count = std::dynamic_extent)
+    {
+        data();
+
+        auto link = std::static_pointer_cast<ViewLink>(_data.borrower());
+        if (link == nullptr)
+            link = std::make_shared<ViewLink>();
+
+        std::span<sample_type> samples(_data.lend(link));
+        return BasicView<sample_type>(samples, channels(), _header.sample_rate, _parallelism, link).frames(first, count);
+    }
+    // Not available in planar layout, same as samples()
+    BasicView<const sample_type> view(size_t first = 0, size_t count = std::dynamic_extent) const
+    {
+        return BasicView<const sample_type>(samples(), channels(), _header.sample_rate, _parallelism).frames(first, count);
+    }
+
+    Layout layout() const { return _layout; }
+
+    // Switches to one aligned buffer per channel, in a single deinterleaving pass
+    BasicWaveform& planar()
+    {
+        if (_layout == Layout::Planar)
+            return *this;
+
+        auto view = samples();
+        int count = channels();
+        size_t frames = view.size() / count;
+
+        allocate_planes(count, frames);
+        simd::deinterleave(view.data(), frames, count, plane_pointers().data());
+
+        _data.clear();
+        _mapping.reset();
+        _view = {};
+        _layout = Layout::Planar;
 
         return *this;
     }
 
-    auto& data() { return _data; }
-    auto data() const { return _data; }
+    // Switches back to file order, in a single interleaving pass
+    BasicWaveform& interleaved()
+    {
+        if (_layout == Layout::Interleaved)
+            return *this;
+
+        Samples samples(num_samples(), _resource);
+        interleave_frames(0, num_frames(), samples.data());
+
+        _data.reset(std::move(samples));
+        _planes.clear();
+        _layout = Layout::Interleaved;
+
+        return *this;
+    }
+
+    // Samples of one channel, contiguous; switches to planar layout and forgets the cached statistics
+    std::span<sample_type> channel(int index)
+    {
+        planar();
+        _analysis.reset();
+        return std::span<sample_type>(_planes.write().at(index));
+    }
+    std::span<const sample_type> channel(int index) const
+    {
+        if (_layout != Layout::Planar)
+            throw std::logic_error("Samples are stored interleaved, call planar() first.");
+
+        return std::span<const sample_type>(_planes->at(index));
+    }
 
     auto& header() { return _header; }
-    auto header() const { return _header; }
+    const WAVHeader& header() const { return _header; }
+
+    // Splits filter(), convolute() and the reductions across `threads` cores (0: all of them), in tasks of at least
+    // `grain` samples. Single-threaded by default
+    BasicWaveform& parallel(int threads, size_t grain = Parallelism::default_grain)
+    {
+        _parallelism = Parallelism { threads, grain };
+        return *this;
+    }
+    const Parallelism& parallelism() const { return _parallelism; }
+
+    // Where sample buffers are allocated from: 64-byte aligned new/delete by default, or e.g. a memory::Pool that
+    // recycles the buffers of waveforms processed one after another. Applies to buffers allocated from then on,
+    // copies inherit it; the resource must outlive every buffer taken from it
+    BasicWaveform& memory(std::pmr::memory_resource* resource)
+    {
+        _resource = resource != nullptr ? resource : memory::aligned();
+        return *this;
+    }
+    std::pmr::memory_resource* memory() const { return _resource; }
+
+    // Time, bytes and samples of every load, filter, convolution, normalization and write so far
+    // Always empty unless compiled with -DWAV_STATS
+    const Stats& stats() const
+    {
+#ifdef WAV_STATS
+        return _stats;
+#else
+        static const Stats empty;
+        return empty;
+#endif
+    }
+    void clear_stats()
+    {
+#ifdef WAV_STATS
+        _stats.clear();
+#endif
+    }
+
+    int channels() const { return Channels != 0 ? Channels : std::max<int>(_header.num_channels, 1); }
+
+    // Samples of all channels together, and samples per channel
+    size_t num_samples() const { return _layout == Layout::Planar ? num_frames() * _planes->size() : samples().size(); }
+    size_t num_frames() const
+    {
+        if (_layout == Layout::Planar)
+            return _planes->empty() ? 0 : _planes->front().size();
 
-    int num_samples() { return _header.subchunk2_size / _header.bits_per_sample; }
-    int num_samples() const { return _header.subchunk2_size / _header.bits_per_sample; }
+        return samples().size() / channels();
+    }
 
+    // Filters providing a block kernel (process(std::span<sample_type>)) are applied through it, others per sample
+    // Interleaved, the samples are split across the configured workers unless the filter is sequential
+    // Planar, every channel runs on its own copy of the filter (so sequential filters keep per-channel state), and
+    // channels are spread across the workers
     template <typename Functor>
-    Waveform& filter(Functor action)
+    BasicWaveform& filter(Functor action)
     {
-        for (short& sample : _data)
-            sample = action(sample);
+        auto timer = time("filter", Stats::Kind::Compute);
+        forget_view_writes();
+        auto analysis = _analysis;
+
+        apply(action);
+        if constexpr (is_s16)
+            carry_extrema(analysis, action);
+        timer.done(num_samples() * sizeof(sample_type), num_samples());
 
         return *this;
     }
 
-    Waveform& convolute(const std::vector<float>& kernel)
+    // Outputs are computed from the original samples only, y[i] = sum(kernel[j] * x[i - j]), saturated to 16 bits
+    BasicWaveform& convolute(const std::vector<float>& kernel)
+        requires is_s16
     {
-        for (int i = 0; i < _data.size(); i++) {
-            short value = 0;
+        return convolute(*Convolver::get(kernel));
+    }
 
-            for (int j = 0; j < kernel.size(); ++j) {
-                if (i - j < 0)
-                    continue;
+    // Runs a cascade of biquad sections (see wav/iir.hpp), designed for the waveform's sample rate, over every
+    // channel. Interleaved channels are filtered in one pass; planar ones are spread across the workers
+    // Throws std::invalid_argument when a section's frequency is not below half the sample rate
+    BasicWaveform& biquad(const iir::Cascade& cascade, iir::Precision precision = iir::Precision::Float)
+        requires is_s16
+    {
+        int width = _layout == Layout::Planar ? 1 : channels();
 
-                if (value + _data[i - j] * kernel[j] >= std::numeric_limits<short>::max())
-                    value = std::numeric_limits<short>::max();
-                else if (value + _data[i - j] * kernel[j] <= std::numeric_limits<short>::min())
-                    value = std::numeric_limits<short>::min();
-                else {
-                    value += (short)(_data[i - j] * kernel[j]);
-                }
-            }
+        if (precision == iir::Precision::Double)
+            return filter(iir::Filter<double>(cascade, _header.sample_rate, width));
+
+        return filter(iir::Filter<float>(cascade, _header.sample_rate, width));
+    }
 
-            _data[i] = value;
+    // Reuse a single Convolver to apply the same impulse response to many files
+    // Every channel is convolved on its own; interleaved multi-channel samples go through the planar layout for it
+    BasicWaveform& convolute(const Convolver& convolver)
+        requires is_s16
+    {
+        auto timer = time("convolute", Stats::Kind::Compute);
+        _analysis.reset();
+
+        if (_layout == Layout::Interleaved && channels() == 1) {
+            auto view = samples();
+            size_t count = view.size();
+
+            // convolve() copies the input, after which a mapped view can be let go
+            Samples output(count, _resource);
+            convolve(convolver, view, output.data(), _parallelism);
+
+            _mapping.reset();
+            _view = {};
+            _data.reset(std::move(output));
+        } else {
+            bool restore = _layout == Layout::Interleaved;
+            planar();
+
+            for_each_channel([&convolver](std::span<short> plane, const Parallelism& parallelism) {
+                convolve(convolver, plane, plane.data(), parallelism);
+            });
+
+            if (restore)
+                interleaved();
         }
 
+        timer.done(num_samples() * sizeof(short), num_samples());
         return *this;
     }
 
-    int save(const std::string& destination = "out.wav")
+    // Limits, compresses or gates the waveform (see wav/dynamics.hpp), with the detector's lookahead delay taken
+    // out again, so nothing moves in time. Linked channels share one gain, so planar samples are processed
+    // interleaved
+    BasicWaveform& dynamics(const dynamics::Settings& settings)
+        requires is_s16
     {
-        std::ofstream file(destination, std::ios::binary);
+        bool restore = _layout == Layout::Planar;
+        interleaved();
 
-        if (file.is_open() == false) {
-            std::cerr << "Error: Could not open " << destination << "." << std::endl;
-            return FAILURE;
-        }
+        auto timer = time("dynamics", Stats::Kind::Compute);
+        auto& samples = data();
 
-        if (write_header(file)) {
-            std::cerr << "Error: Could not save header data to " << destination << "." << std::endl;
-            file.close();
+        dynamics::Processor processor(settings, _header.sample_rate, channels());
+        processor.process(samples);
 
-            return FAILURE;
+        // Output lags by latency() frames: drop that much of the silence in front and render the frames behind the
+        // end from silence
+        std::vector<short> tail(processor.latency() * channels(), 0);
+        processor.process(tail);
+
+        size_t shift = std::min(tail.size(), samples.size());
+        std::move(samples.begin() + (ptrdiff_t)shift, samples.end(), samples.begin());
+        std::copy(tail.end() - (ptrdiff_t)shift, tail.end(), samples.end() - (ptrdiff_t)shift);
+
+        timer.done(samples.size() * sizeof(short), samples.size());
+
+        if (restore)
+            planar();
+
+        return *this;
+    }
+
+    // Converts to `rate` frames per second with a polyphase filter bank (see wav/resample.hpp), channel by channel,
+    // and updates the header; the filter tables for each pair of rates are built once and shared
+    BasicWaveform& resample(int rate)
+        requires is_s16
+    {
+        return resample(*Resampler::get(_header.sample_rate, rate));
+    }
+
+    BasicWaveform& resample(const Resampler& resampler)
+        requires is_s16
+    {
+        if (resampler.from() != _header.sample_rate)
+            throw std::invalid_argument("Resampler does not start at the waveform's sample rate.");
+
+        if (resampler.to() == resampler.from())
+            return *this;
+
+        auto timer = time("resample", Stats::Kind::Compute);
+        _analysis.reset();
+
+        int count = channels();
+        size_t frames = num_frames();
+        size_t produced = (size_t)resampler.frames(frames);
+
+        if (_layout == Layout::Planar) {
+            for (auto& plane : _planes.write()) {
+                Samples output(produced, _resource);
+                resampler.process(plane.data(), frames, 1, output.data(), _parallelism);
+                plane = std::move(output);
+            }
+        } else {
+            auto view = samples();
+            Samples output(produced * count, _resource);
+            for (int channel = 0; channel < count; channel++)
+                resampler.process(view.data() + channel, frames, count, output.data() + channel, _parallelism);
+
+            _mapping.reset();
+            _view = {};
+            _data.reset(std::move(output));
         }
 
-        if (write_data(file)) {
-            std::cerr << "Error: Could not save information data to " << destination << "."
-                      << std::endl;
-            file.close();
+        _header.sample_rate = resampler.to();
+        _header.byte_rate = resampler.to() * _header.block_align;
 
-            return FAILURE;
+        timer.done(frames * count * sizeof(short), produced * count);
+        return *this;
+    }
+
+    // Mapped output pre-sizes the destination file and fills it through a writable mapping
+    // Pass verbose = false to skip the confirmation message, e.g. when saving in a loop
+    int save(const std::string& destination = "out.wav", IOMode mode = IOMode::Buffered, bool verbose = true)
+    {
+        // Rewriting the file that backs our own view would pull the samples from under us
+        if (is_mapped() && refers_to(destination))
+            materialize();
+
+        if (mode == IOMode::Mapped) {
+            if (write_mapped(destination))
+                return FAILURE;
+        } else {
+            std::ofstream file(destination, std::ios::binary);
+
+            if (file.is_open() == false) {
+                std::cerr << "Error: Could not open " << destination << "." << std::endl;
+                return FAILURE;
+            }
+
+            if (write_header(file)) {
+                std::cerr << "Error: Could not save header data to " << destination << "." << std::endl;
+                file.close();
+
+                return FAILURE;
+            }
+
+            if (write_data(file)) {
+                std::cerr << "Error: Could not save information data to " << destination << "."
+                          << std::endl;
+                file.close();
+
+                return FAILURE;
+            }
+
+            // Caller-cleanup
+            file.close();
         }
 
-        // Caller-cleanup
-        file.close();
-        std::cout << "Sucessfully saved to " << destination << "." << std::endl;
+        if (verbose)
+            std::cout << "Sucessfully saved to " << destination << "." << std::endl;
 
         return SUCCESS;
     }
 
-    int load(const std::string& source)
+    int load(const std::string& source, IOMode mode = IOMode::Buffered, Layout layout = Layout::Interleaved)
     {
         std::ifstream file(source, std::ios::binary);
         if (file.is_open() == false) {
@@ -292,9 +1083,27 @@ public:
         // Reinitialize the header
         init_header(file);
 
-        // Clear and reinitialize the data container
+        // Drop both the previous samples and a previous mapping
         _data.clear();
-        init_data(file);
+        _mapping.reset();
+        _view = {};
+        _planes.clear();
+        _layout = Layout::Interleaved;
+        _analysis.reset();
+
+        if (mode == IOMode::Mapped) {
+            // The header has been parsed, the samples are served straight from the page cache
+            // (and deinterleaved from there in planar layout)
+            file.close();
+            init_data(std::make_shared<const MappedFile>(source));
+
+            if (layout == Layout::Planar)
+                planar();
+
+            return SUCCESS;
+        }
+
+        init_data(file, layout);
 
         // Callee-cleanup
         file.close();
@@ -302,44 +1111,7 @@ public:
         return SUCCESS;
     }
 
-    void print_header(std::ostream& os = std::cout)
-    {
-        auto to_string = [](const std::array<char, 4>& arr) {
-            std::string ret = "";
-            for (const auto& elem : arr)
-                ret += elem;
-
-            return std::string(ret);
-        };
-
-        auto chunk_id = to_string(_header.chunk_id);
-        auto format = to_string(_header.format);
-        auto subchunk1_id = to_string(_header.subchunk1_id);
-        auto subchunk2_id = to_string(_header.subchunk2_id);
-
-        os << std::setw(24) << "- RIFF chunk descriptor -" << std::endl;
-        os << std::setw(18) << "chunk_id: " << chunk_id << std::endl;
-        os << std::setw(18) << "chunk_size: " << _header.chunk_size << std::endl;
-        os << std::setw(18) << "format: " << format << std::endl;
-
-        os << std::setw(24) << "\n- FMT sub-chunk - " << std::endl;
-        os << std::setw(18) << "subchunk1_id: " << subchunk1_id << std::endl;
-        os << std::setw(18) << "audio_format: " << _header.audio_format << std::endl;
-        os << std::setw(18) << "num_channels: " << _header.num_channels << std::endl;
-        os << std::setw(18) << "sample_rate: " << _header.sample_rate << std::endl;
-        os << std::setw(18) << "byte_rate: " << _header.byte_rate << std::endl;
-        os << std::setw(18) << "block_align: " << _header.block_align << std::endl;
-        os << std::setw(18) << "bits_per_sample: " << _header.bits_per_sample << std::endl;
-
-        os << std::setw(24) << "\n- DATA sub-chunk - " << std::endl;
-        os << std::setw(18) << "subchunk2_id: " << subchunk2_id << std::endl;
-        os << std::setw(18) << "subchunk2_size: " << _header.subchunk2_size << std::endl;
-
-        // length = (total_sample_bytes / bytes_per_sample) / sample_rate
-        double length = (double)(_header.subchunk2_size) / (_header.bits_per_sample / 8) / (double)(_header.sample_rate);
-
-        os << std::setw(18) << "\nLength: " << length << "s" << std::endl;
-    }
+    void print_header(std::ostream& os = std::cout) { wav::print_header(_header, os); }
 
     std::ostream& print_data(std::ostream& os,
         const std::function<std::ostream&(std::ostream&)>& format,
@@ -348,8 +1120,15 @@ public:
     {
         format(os);
 
-        for (int i = from; i < amount; i++)
-            os << _data[i] << " ";
+        std::vector<sample_type> copy;
+        if (_layout == Layout::Planar) {
+            copy.resize(num_samples());
+            interleave_frames(0, num_frames(), copy.data());
+        }
+
+        auto view = _layout == Layout::Planar ? std::span<const sample_type>(copy) : samples();
+        for (size_t i = from; i < amount && i < view.size(); i++)
+            os << view[i] << " ";
 
         return os << std::endl;
     }
@@ -357,148 +1136,568 @@ public:
     // Demo functionality
 public:
     void normalize()
+        requires is_s16
     {
-        float amplification_factor = 1 / maximum_amplitude();
-        normalize(amplification_factor);
+        auto timer = time("normalize", Stats::Kind::Compute);
+        normalize(normalization_factor(extrema().peak()));
+        timer.done(num_samples() * sizeof(sample_type), num_samples());
     }
 
-    short maximum_intensity()
+    // Computed once and cached until the samples change
+    const SignalStats& analyze() const
+        requires is_s16
     {
-        short max = _data[0];
+        forget_view_writes();
+        if (_analysis.has_value() == false || _extrema_only) {
+            if (_layout == Layout::Planar) {
+                SignalStats stats;
+                for (const auto& plane : *_planes)
+                    stats.merge(summarize(plane, _parallelism));
+
+                _analysis = stats;
+            } else {
+                _analysis = summarize(samples(), _parallelism);
+            }
 
-        for (const short& sample : _data)
-            if (std::abs(sample) > std::abs(max))
-                max = sample;
+            _extrema_only = false;
+        }
 
-        return max;
+        return *_analysis;
+    }
+
+    // Largest-magnitude sample, the positive one on ties
+    short maximum_intensity() const
+        requires is_s16
+    {
+        return extrema().peak_sample();
+    }
+    float maximum_amplitude() const
+        requires is_s16
+    {
+        return (float)maximum_intensity() / (INT16_MAX - 1);
+    }
+
+    // Short-time Fourier analysis of every channel (see wav/stft.hpp), frames spread across the workers
+    // sink(frame, magnitudes) is called for every frame in order, with channels() * bins() magnitudes
+    template <typename Sink>
+    void spectrum(const stft::Analyzer& analyzer, Sink sink) const
+        requires is_s16
+    {
+        size_t stride;
+        auto pointers = channel_pointers(stride);
+        analyzer.process(pointers, num_frames(), stride, sink, _parallelism);
+    }
+
+    // Min/max/RMS pyramid of every channel (see wav/overview.hpp), for drawing the waveform at any zoom without
+    // scanning the samples again; level 0 is split across the workers
+    Overview overview(uint32_t base = Overview::default_base, uint32_t factor = Overview::default_factor) const
+        requires is_s16
+    {
+        size_t stride;
+        auto pointers = channel_pointers(stride);
+        return Overview(pointers, num_frames(), stride, _header.sample_rate, _parallelism, base, factor);
+    }
+
+    // Writes a spectrogram file (see stft::SpectrogramWriter), without holding the magnitudes in memory
+    int spectrogram(const std::string& destination, const stft::Settings& settings = {}, bool verbose = true) const
+        requires is_s16
+    {
+        stft::Analyzer analyzer(settings);
+        std::optional<stft::SpectrogramWriter> writer;
+
+        try {
+            writer.emplace(destination, analyzer, _header.sample_rate, channels());
+        } catch (const std::runtime_error&) {
+            std::cerr << "Error: Could not open " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        spectrum(analyzer, [&writer](uint64_t, std::span<const float> magnitudes) { writer->write(magnitudes); });
+
+        if (writer->close() == false) {
+            std::cerr << "Error: Could not save spectrogram to " << destination << "." << std::endl;
+            return FAILURE;
+        }
+
+        if (verbose)
+            std::cout << "Sucessfully saved to " << destination << "." << std::endl;
+
+        return SUCCESS;
     }
-    float maximum_amplitude() { return (float)maximum_intensity() / (INT16_MAX - 1); }
 
 private:
+    // Not through filter(), so the gain is accounted for under "normalize" only
     void normalize(float factor)
+        requires is_s16
     {
-        demo::filters::Gain<float, short> normalizator = demo::filters::Gain<float, short>(factor);
+        demo::filters::Gain<float, short> gain(factor);
+        forget_view_writes();
+        auto analysis = _analysis;
 
-        for (short& sample : _data)
-            sample = normalizator(sample);
+        apply(gain);
+        carry_extrema(analysis, gain);
     }
-    size_t init_header(std::ifstream& file)
+
+    // Runs a filter over the samples in either layout, see filter()
+    template <typename Functor>
+    void apply(Functor& action)
+    {
+        if (_layout == Layout::Interleaved) {
+            apply_filter(action, std::span<sample_type>(data()), _parallelism);
+            return;
+        }
+
+        _analysis.reset();
+        for_each_channel([&action](std::span<sample_type> plane, const Parallelism& parallelism) {
+            Functor local = action;
+            apply_filter(local, plane, parallelism);
+        });
+    }
+
+    // Calls body(plane, parallelism) for every channel of a planar waveform
+    // With several channels and workers, the channels are the parallel tasks and each runs single-threaded;
+    // otherwise the configured parallelism is passed on to the body
+    template <typename Body>
+    void for_each_channel(Body body)
     {
-        // TODO: implement skipping chunks not identified as id == 'fmt' || 'data'
+        auto& planes = _planes.write();
 
-        char chunk_id[4], format[4], subchunk1_id[4], subchunk2_id[4];
-        size_t bytes_read;
+        if (planes.size() > 1 && _parallelism.workers() > 1) {
+            Parallelism by_channel { _parallelism.threads, 1 };
 
-        // Set cursor to the header start
-        file.seekg(std::ios::beg);
+            parallel_for(planes.size(), by_channel, [&](size_t, size_t begin, size_t end) {
+                for (size_t channel = begin; channel < end; channel++)
+                    body(std::span<sample_type>(planes[channel]), Parallelism {});
+            });
+            return;
+        }
 
-        // Read the RIFF chunk descriptor
-        file.read(chunk_id, 4);
-        file.read((char*)&_header.chunk_size, 4);
-        file.read(format, 4);
-        bytes_read = 12;
+        for (auto& plane : planes)
+            body(std::span<sample_type>(plane), _parallelism);
+    }
 
-        // Read the 'fmt' subchunk:
-        file.read(subchunk1_id, 4);
-        file.read((char*)&_header.subchunk1_size, 4);
-        file.read((char*)&_header.audio_format, 2);
-        file.read((char*)&_header.num_channels, 2);
-        file.read((char*)&_header.sample_rate, 4);
-        file.read((char*)&_header.byte_rate, 4);
-        file.read((char*)&_header.block_align, 2);
-        file.read((char*)&_header.bits_per_sample, 2);
-        bytes_read += 24;
+    // Convolves `input` into `output` (which may alias it), with zero history in front of the first sample
+    static void convolve(const Convolver& convolver, std::span<const short> input, short* output,
+        const Parallelism& parallelism)
+    {
+        // Scratch, recycled by the calling thread's pool
+        size_t history = convolver.size() > 0 ? convolver.size() - 1 : 0;
+        std::pmr::vector<short> padded(history + input.size(), &memory::local());
+        std::copy(input.begin(), input.end(), padded.begin() + (ptrdiff_t)history);
 
-        // Read the 'data' subchunk:
-        file.read(subchunk2_id, 4);
-        file.read((char*)&_header.subchunk2_size, 4);
-        bytes_read += 8;
+        convolver.valid(padded.data(), input.size(), output, parallelism);
+    }
 
-        // Initialize our std::arrays with previously-initialized char[]'s
-        for (short i = 0; i < 4; i++) {
-            _header.chunk_id[i] = chunk_id[i];
-            _header.format[i] = format[i];
-            _header.subchunk1_id[i] = subchunk1_id[i];
-            _header.subchunk2_id[i] = subchunk2_id[i];
+    // Built in place, each plane is touched once (assign() would copy a zeroed prototype into every one)
+    void allocate_planes(size_t count, size_t frames)
+    {
+        auto& planes = _planes.reset(std::pmr::vector<Samples>(_resource));
+        planes.reserve(count);
+        for (size_t channel = 0; channel < count; channel++)
+            planes.emplace_back(frames);
+    }
+
+    std::vector<sample_type*> plane_pointers()
+    {
+        std::vector<sample_type*> pointers;
+        for (auto& plane : _planes.write())
+            pointers.push_back(plane.data());
+
+        return pointers;
+    }
+
+    // First sample of every channel, and the distance from one sample of a channel to the next
+    std::vector<const sample_type*> channel_pointers(size_t& stride) const
+    {
+        std::vector<const sample_type*> pointers;
+        stride = 1;
+
+        if (_layout == Layout::Planar) {
+            for (const auto& plane : *_planes)
+                pointers.push_back(plane.data());
+        } else {
+            for (int channel = 0; channel < channels(); channel++)
+                pointers.push_back(samples().data() + channel);
+            stride = channels();
         }
 
-        return bytes_read;
+        return pointers;
+    }
+
+    // Interleaves `count` frames of the planar samples, starting at `first`, into `out`
+    void interleave_frames(size_t first, size_t count, sample_type* out) const
+    {
+        std::vector<const sample_type*> pointers;
+        for (const auto& plane : *_planes)
+            pointers.push_back(plane.data() + first);
+
+        simd::interleave(pointers.data(), count, (int)pointers.size(), out);
+    }
+
+    // Drops the cached statistics once writable views have modified the samples
+    void forget_view_writes() const
+    {
+        auto link = std::static_pointer_cast<ViewLink>(_data.borrower());
+        if (link && link->modified())
+            _analysis.reset();
+    }
+
+    // Cached statistics whose min and max are valid, possibly carried over through filters
+    const SignalStats& extrema() const
+        requires is_s16
+    {
+        forget_view_writes();
+        return _analysis.has_value() ? *_analysis : analyze();
+    }
+
+    // Maps the extrema from before a filter through it, when the filter keeps (or reverses) the order of samples
+    template <typename Functor>
+    void carry_extrema(const std::optional<SignalStats>& before, Functor action)
+    {
+        if constexpr (MonotonicFilter<Functor>) {
+            int direction = action.monotonic();
+            if (before.has_value() == false || direction == 0 || before->count == 0)
+                return;
+
+            short low = before->min, high = before->max;
+            low = action(low);
+            high = action(high);
+
+            SignalStats carried;
+            carried.count = before->count;
+            carried.min = direction > 0 ? low : high;
+            carried.max = direction > 0 ? high : low;
+
+            _analysis = carried;
+            _extrema_only = true;
+        }
+    }
+
+#ifdef WAV_STATS
+    StageTimer time(const char* stage, Stats::Kind kind) { return StageTimer(&_stats, stage, kind); }
+#else
+    StageTimer time(const char* stage, Stats::Kind kind) { return StageTimer(nullptr, stage, kind); }
+#endif
+
+    // Copies a mapped view into owned storage, so that it can be modified
+    void materialize()
+    {
+        if (is_mapped() == false)
+            return;
+
+        _data.reset(Samples(_view.begin(), _view.end(), _resource));
+        _view = {};
+        _mapping.reset();
+    }
+    size_t init_header(std::ifstream& file)
+    {
+        auto timer = time("init_header", Stats::Kind::IO);
+        _data_offset = read_header(file, _header);
+        timer.done(_data_offset, 0);
+
+        if (holds<Format>(_header) == false)
+            throw std::runtime_error("Specified file does not match the waveform's sample format.");
+
+        if (Channels != 0 && _header.num_channels != Channels)
+            throw std::runtime_error("Specified file does not match the waveform's channel count.");
+
+        return _data_offset;
+    }
+
+    // Number of bytes the data chunk claims, clamped to what is actually available after the header
+    size_t data_bytes(size_t available) const
+    {
+        size_t declared = static_cast<uint32_t>(_header.subchunk2_size);
+        size_t bytes = std::min(declared, available);
+
+        return bytes - bytes % format::stored_bytes<Format>;
     }
 
-    size_t init_data(std::ifstream& file)
+    // Packed samples are read through a small buffer and widened on the way, in a single pass
+    static constexpr size_t packed_block = 16384;
+
+    size_t init_data(std::ifstream& file, Layout layout = Layout::Interleaved)
     {
-        // Seek to the beginning of the (actual) information sector
+        auto timer = time("init_data", Stats::Kind::IO);
+
+        // Find out how much data follows the header, so the whole chunk can be read at once
+        file.seekg(0, std::ios_base::end);
+        std::streamoff file_size = file.tellg();
+
+        // Seek to the beginning of the (actual) information sector, found by read_header
         // Refer to "wav_header_format.jpg" for additional information
-        file.seekg(44, std::ios_base::beg);
+        file.seekg((std::streamoff)_data_offset, std::ios_base::beg);
 
-        // Initialize our samples vector
-        short sample;
+        size_t available = file_size > (std::streamoff)_data_offset ? static_cast<size_t>(file_size) - _data_offset : 0;
+        size_t bytes = data_bytes(available);
+
+        constexpr size_t stored = format::stored_bytes<Format>;
         size_t bytes_read = 0;
-        size_t bytes_per_sample = _header.bits_per_sample / 8;
 
-        // num_data_bytes / bytes_per_sample * sample_size -- this works idk lol
-        for (int i = 0; i < _header.subchunk2_size / bytes_per_sample * 2; i += bytes_per_sample) {
-            // Read one sample (2 bytes for 16bpp)
-            file.read((char*)&sample, _header.bits_per_sample / 8);
-            bytes_read += _header.bits_per_sample / 8;
+        if (Format::packed == false && layout == Layout::Interleaved) {
+            // Single allocation, single read
+            auto& data = _data.reset(Samples(bytes / stored, _resource));
+            file.read((char*)data.data(), bytes);
+
+            bytes_read = static_cast<size_t>(file.gcount());
+            data.resize(bytes_read / stored);
+
+            timer.done(bytes_read, data.size());
+            return bytes_read;
+        }
+
+        // Packed or planar: blocks of frames go through a small buffer, are widened and deinterleaved on the way
+        bool planar = layout == Layout::Planar;
+        size_t width = planar ? (size_t)channels() : 1;
+        size_t frames = bytes / stored / width;
+
+        if (planar)
+            allocate_planes(width, frames);
+        else
+            _data.reset(Samples(frames, _resource));
 
-            _data.push_back(sample);
+        std::pmr::vector<char> buffer(packed_block * width * stored, &memory::local());
+        std::pmr::vector<sample_type> block(planar ? packed_block * width : 0, &memory::local());
+
+        size_t done = 0;
+        while (done < frames) {
+            size_t count = std::min(packed_block, frames - done);
+            file.read(buffer.data(), count * width * stored);
+
+            size_t complete = static_cast<size_t>(file.gcount()) / (width * stored);
+            sample_type* target = planar ? block.data() : _data.write().data() + done;
+
+            if constexpr (Format::packed)
+                Format::decode(buffer.data(), target, complete * width);
+            else
+                memcpy(target, buffer.data(), complete * width * stored);
+
+            if (planar) {
+                std::vector<sample_type*> pointers = plane_pointers();
+                for (auto& pointer : pointers)
+                    pointer += done;
+
+                simd::deinterleave(block.data(), complete, (int)width, pointers.data());
+            }
+
+            done += complete;
+            bytes_read += complete * width * stored;
+            if (complete < count)
+                break;
+        }
+
+        if (planar) {
+            for (auto& plane : _planes.write())
+                plane.resize(done);
+            _layout = Layout::Planar;
+        } else {
+            _data.write().resize(done);
         }
 
+        timer.done(bytes_read, done * width);
         return bytes_read;
     }
 
+    // Only the mapping is timed here, page faults are paid for by whatever touches the samples first
+    size_t init_data(std::shared_ptr<const MappedFile> mapping)
+    {
+        auto timer = time("init_data", Stats::Kind::IO);
+        size_t available = mapping->size() > _data_offset ? mapping->size() - _data_offset : 0;
+        size_t bytes = data_bytes(available);
+        const char* begin = mapping->data() + _data_offset;
+
+        // Packed samples need widening, and samples at a misaligned offset (only found in malformed files) cannot
+        // be viewed in place; both are copied out of the mapping instead
+        if (Format::packed || _data_offset % alignof(sample_type) != 0) {
+            auto& data = _data.reset(Samples(bytes / format::stored_bytes<Format>, _resource));
+            if constexpr (Format::packed)
+                Format::decode(begin, data.data(), data.size());
+            else
+                memcpy(data.data(), begin, bytes);
+
+            timer.done(bytes, data.size());
+            return bytes;
+        }
+
+        _view = std::span<const sample_type>(reinterpret_cast<const sample_type*>(begin), bytes / sizeof(sample_type));
+        _mapping = std::move(mapping);
+        timer.done(bytes, _view.size());
+
+        return bytes;
+    }
+
+    size_t stored_size() const { return num_samples() * format::stored_bytes<Format>; }
+
+    std::array<char, 44> encode_header() const { return wav::encode_header(_header, stored_size()); }
+
     int write_header(std::ofstream& file)
     {
-        try {
-            // Write the RIFF chunk descriptor
-            file.write((char*)&_header.chunk_id, 4);
-            file.write((char*)&_header.chunk_size, 4);
-            file.write((char*)&_header.format, 4);
-
-            // Write the 'fmt' sub-chunk
-            file.write((char*)&_header.subchunk1_id, 4);
-            file.write((char*)&_header.subchunk1_size, 4);
-            file.write((char*)&_header.audio_format, 2);
-            file.write((char*)&_header.num_channels, 2);
-            file.write((char*)&_header.sample_rate, 4);
-            file.write((char*)&_header.byte_rate, 4);
-            file.write((char*)&_header.block_align, 2);
-            file.write((char*)&_header.bits_per_sample, 2);
-
-            // Write the 'data' sub-chunk
-            file.write((char*)&_header.subchunk2_id, 4);
-            file.write((char*)&_header.subchunk2_size, 4);
-        } catch (...) {
-            return FAILURE;
+        auto bytes = encode_header();
+        file.write(bytes.data(), bytes.size());
+
+        return file.good() ? SUCCESS : FAILURE;
+    }
+
+    // Hands the samples to sink(bytes, size) in file order and encoding, which returns false to stop
+    // Samples stored as they sit in memory go in one piece; planar or packed ones block by block through a small
+    // buffer, interleaved and encoded on the way
+    template <typename Sink>
+    void write_blocks(Sink sink) const
+    {
+        constexpr size_t stored = format::stored_bytes<Format>;
+
+        if (Format::packed == false && _layout == Layout::Interleaved) {
+            auto view = samples();
+            if (view.empty() == false)
+                sink((const char*)view.data(), view.size_bytes());
+            return;
         }
 
-        return SUCCESS;
+        bool planar = _layout == Layout::Planar;
+        size_t width = planar ? _planes->size() : 1;
+        size_t frames = planar ? num_frames() : samples().size();
+
+        std::pmr::vector<sample_type> block(planar ? packed_block * width : 0, &memory::local());
+        std::pmr::vector<char> buffer(Format::packed ? packed_block * width * stored : 0, &memory::local());
+
+        for (size_t done = 0; done < frames;) {
+            size_t count = std::min(packed_block, frames - done);
+
+            const sample_type* source = samples_at(done, count, block.data());
+            const char* bytes = (const char*)source;
+            if constexpr (Format::packed) {
+                Format::encode(source, buffer.data(), count * width);
+                bytes = buffer.data();
+            }
+
+            if (sink(bytes, count * width * stored) == false)
+                return;
+
+            done += count;
+        }
+    }
+
+    // `count` frames in file order from frame `first`, interleaved into `block` when the layout is planar
+    const sample_type* samples_at(size_t first, size_t count, sample_type* block) const
+    {
+        if (_layout == Layout::Interleaved)
+            return samples().data() + first;
+
+        interleave_frames(first, count, block);
+        return block;
     }
 
     int write_data(std::ofstream& file)
     {
-        // Seek to the beginning of the (actual) information sector
-        // Refer to "wav_header_format.jpg" for additional information
-        file.seekp(0x2C, std::ios_base::beg);
+        // The header has just been written, so the stream already sits at the information sector
+        auto timer = time("write_data", Stats::Kind::IO);
 
-        size_t bytes_written = 0;
-        int bytes_per_sample = _header.bits_per_sample / 8;
+        write_blocks([&file](const char* bytes, size_t size) {
+            file.write(bytes, size);
+            return file.good();
+        });
 
-        for (const short& elem : _data)
-            try {
-                file.write((char*)&elem, bytes_per_sample);
-                bytes_written += bytes_per_sample;
-            } catch (...) {
-                return FAILURE;
-            }
+        timer.done(stored_size(), num_samples());
+        return file.good() ? SUCCESS : FAILURE;
+    }
+
+    int write_mapped(const std::string& destination)
+    {
+        auto timer = time("write_data", Stats::Kind::IO);
+        auto header = encode_header();
 
-        // std::cout << "Written " << bytes_written << " bytes." << std::endl;
+        try {
+            MappedFile file(destination, header.size() + stored_size());
+
+            memcpy(file.data(), header.data(), header.size());
+
+            char* out = file.data() + header.size();
+            write_blocks([&out](const char* bytes, size_t size) {
+                memcpy(out, bytes, size);
+                out += size;
+                return true;
+            });
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Error: Could not save to " << destination << " (" << e.what() << ")." << std::endl;
+            return FAILURE;
+        }
 
+        timer.done(stored_size(), num_samples());
         return SUCCESS;
     }
+
+    // Whether the destination is the very file our mapped view was taken from
+    bool refers_to(const std::string& destination) const
+    {
+        std::error_code error;
+        return std::filesystem::equivalent(_mapping->path(), destination, error);
+    }
 };
 
+// 16-bit PCM with any number of interleaved channels
+using Waveform = BasicWaveform<format::S16>;
+
+// Loads a file into the BasicWaveform matching its sample format and calls visitor(waveform) with it, so one
+// generic visitor gets a specialized instantiation per format. Throws on formats without a sample type
+template <int Channels = 0, typename Visitor>
+auto visit(const std::string& filename, Visitor visitor, IOMode mode = IOMode::Buffered)
+    -> std::invoke_result_t<Visitor, BasicWaveform<format::S16, Channels>&>
+{
+    WAVHeader header = probe(filename).header;
+
+    auto load = [&]<typename Format>(Format) {
+        BasicWaveform<Format, Channels> waveform(filename, mode);
+        return visitor(waveform);
+    };
+
+    if (holds<format::U8>(header))
+        return load(format::U8 {});
+    if (holds<format::S16>(header))
+        return load(format::S16 {});
+    if (holds<format::S24>(header))
+        return load(format::S24 {});
+    if (holds<format::S32>(header))
+        return load(format::S32 {});
+    if (holds<format::F32>(header))
+        return load(format::F32 {});
+
+    throw std::runtime_error("Specified file has an unsupported sample format.");
+}
+
+// Overview of a 16-bit file (see wav/overview.hpp) from its sidecar, `filename` + ".overview"
+// The sidecar is built from the (mapped) samples and saved next to the file when it is missing, older than the file
+// or describes a different number of frames; where it cannot be saved, the overview is built every time
+inline Overview overview(const std::string& filename, const Parallelism& parallelism = {})
+{
+    std::string sidecar = filename + ".overview";
+    std::error_code error, missing;
+
+    Probe info = probe(filename);
+    size_t size = (size_t)std::filesystem::file_size(filename, error);
+    size_t bytes = std::min(info.data_bytes(), size > info.data_offset ? size - info.data_offset : 0);
+    size_t frames = bytes / std::max<size_t>(info.header.block_align, 1);
+
+    auto source_time = std::filesystem::last_write_time(filename, error);
+    auto sidecar_time = std::filesystem::last_write_time(sidecar, missing);
+
+    if (!error && !missing && sidecar_time >= source_time) {
+        try {
+            Overview cached(sidecar);
+            if (cached.frames() == frames && cached.channels() == std::max<int>(info.header.num_channels, 1))
+                return cached;
+        } catch (const std::runtime_error&) {
+        }
+    }
+
+    Waveform waveform(filename, IOMode::Mapped);
+    waveform.parallel(parallelism.threads, parallelism.grain);
+
+    Overview built = waveform.overview();
+    built.save(sidecar);
+
+    return built;
+}
+
 } // namespace wav
 
 #endif
\ No newline at end of file